@@ -0,0 +1,265 @@
+/*
+  kforth-bench : in-process benchmark runner over the kf_vm API.
+
+  Each benchmark loads its definitions file from bench/ into a VM cloned from a
+  bootstrapped template, then times kf_vm_eval() of its run text on fresh
+  clones of that VM. Output goes to a sink, so terminal speed is not timed.
+
+    kforth_bench [--reps N] [--warmup N] [--only NAME] [--out FILE]
+                 [--baseline FILE] [--threshold PCT] [--root DIR]
+
+  Results are JSON, one benchmark per line. words is the number of cells the
+  checked run executed (kf_vm_cells_run), so words_per_sec follows the engine
+  as it changes. With --baseline, a median more than PCT percent (default 10)
+  above the baseline's is reported and the exit status is 1.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "kforth_api.h"
+
+#ifndef KFORTH_BENCH_ROOT
+#define KFORTH_BENCH_ROOT "."
+#endif
+
+typedef struct Bench {
+  const char *name;
+  const char *defs;     /* file under the root, NULL: none */
+  const char *run;      /* timed text; "@file" reads it from the root */
+  int         repeat;   /* run text is evaluated this many times back to back */
+  const char *expect;   /* must appear in the output of the first run */
+  int         bare;     /* start from the bare core instead of bootstrap */
+} Bench;
+
+static const Bench benches[] = {
+  { "sieve-1000",  "bench/sieve.fth",   "1000 200 SIEVES .\n",  1,   "168 ",     0 },
+  { "sieve-4000",  "bench/sieve.fth",   "4000 50 SIEVES .\n",   1,   "550 ",     0 },
+  { "sieve-16000", "bench/sieve.fth",   "16000 12 SIEVES .\n",  1,   "1862 ",    0 },
+  { "fib-27",      "bench/fib.fth",     "27 FIB .\n",           1,   "196418 ",  0 },
+  { "fadd",        "bench/float.fth",   "200000 FADDS 1000 S>F FDIV F.\n", 1, "200.",     0 },
+  { "fmul",        "bench/float.fth",   "40000 FMULS F.\n",     1,   NULL,       0 },
+  { "fdiv",        "bench/float.fth",   "50000 FDIVS F.\n",     1,   NULL,       0 },
+  { "fnumber",     "bench/fnumber.fth", "500 FROUNDS\n",        1,   "3.1415 ",  0 },
+  { "output",      "bench/output.fth",  "50000 LINES\n",        1,   "lazy dog", 0 },
+  { "lookup",      NULL,                "@bench/lookup.fth",  20000, NULL,       0 },
+  { "bootstrap",   NULL,                "@bootstrap.fth",      1,    NULL,       1 },
+};
+enum { N_BENCH = (int)(sizeof(benches) / sizeof(benches[0])) };
+
+/* ===== output sinks ===== */
+typedef struct Capture {
+  char   buf[65536];
+  size_t n;
+} Capture;
+
+static void out_capture(void *ctx, const uint8_t *buf, size_t len){
+  Capture *c = (Capture *)ctx;
+  size_t room = sizeof(c->buf) - 1 - c->n;
+  if(len > room) len = room;
+  memcpy(c->buf + c->n, buf, len);
+  c->n += len;
+  c->buf[c->n] = '\0';
+}
+
+static void out_discard(void *ctx, const uint8_t *buf, size_t len){
+  (void)buf;
+  *(size_t *)ctx += len;
+}
+
+/* ===== helpers ===== */
+static const char *root = KFORTH_BENCH_ROOT;
+
+static char *read_path(const char *path, size_t *len){
+  FILE *f = fopen(path, "rb");
+  if(!f){ fprintf(stderr, "kforth-bench: cannot open %s\n", path); exit(2); }
+  fseek(f, 0, SEEK_END);
+  long n = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char *s = (char *)malloc((size_t)n + 1);
+  if(!s || fread(s, 1, (size_t)n, f) != (size_t)n){ fprintf(stderr, "kforth-bench: cannot read %s\n", path); exit(2); }
+  fclose(f);
+  s[n] = '\0';
+  *len = (size_t)n;
+  return s;
+}
+
+static char *read_file(const char *rel, size_t *len){
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s", root, rel);
+  return read_path(path, len);
+}
+
+static double now_ms(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static int cmp_double(const void *a, const void *b){
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/* evaluate text in a clone of tmpl; stop on an error or missing expect text */
+static kf_vm *eval_checked(const kf_vm *tmpl, const char *text, size_t len, const char *what, const char *expect){
+  Capture *c = (Capture *)calloc(1, sizeof(Capture));
+  kf_vm *v = kf_vm_create(tmpl);
+  if(!c || !v){ fprintf(stderr, "kforth-bench: no memory\n"); exit(2); }
+  kf_vm_set_output(v, out_capture, c);
+  if(kf_vm_eval(v, text, len) != 0 || strstr(c->buf, "? ")){
+    fprintf(stderr, "kforth-bench: %s failed:\n%s\n", what, c->buf);
+    exit(2);
+  }
+  if(expect && !strstr(c->buf, expect)){
+    fprintf(stderr, "kforth-bench: %s: expected '%s' in:\n%s\n", what, expect, c->buf);
+    exit(2);
+  }
+  kf_vm_set_output(v, NULL, NULL);
+  free(c);
+  return v;
+}
+
+/* ===== baseline ===== */
+typedef struct Result {
+  const char *name;
+  double median, p95;
+} Result;
+
+/* median_ms for name from a file written by this tool; <0 if absent */
+static double baseline_median(const char *text, const char *name){
+  char key[128];
+  snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+  const char *p = strstr(text, key);
+  if(!p) return -1.0;
+  const char *m = strstr(p, "\"median_ms\": ");
+  const char *eol = strchr(p, '\n');
+  if(!m || (eol && m > eol)) return -1.0;
+  return strtod(m + 13, NULL);
+}
+
+static int compare(const char *path, const Result *r, int n, double threshold){
+  size_t len;
+  char *text = read_path(path, &len);
+  int bad = 0;
+  fprintf(stderr, "%-12s %10s %10s %8s\n", "benchmark", "base ms", "now ms", "change");
+  for(int i=0;i<n;i++){
+    double b = baseline_median(text, r[i].name);
+    if(b <= 0.0){ fprintf(stderr, "%-12s %10s %10.3f\n", r[i].name, "-", r[i].median); continue; }
+    double pct = (r[i].median - b) * 100.0 / b;
+    int slow = pct > threshold;
+    bad |= slow;
+    fprintf(stderr, "%-12s %10.3f %10.3f %+7.1f%%%s\n", r[i].name, b, r[i].median, pct, slow ? "  REGRESSION" : "");
+  }
+  free(text);
+  return bad;
+}
+
+/* ===== main ===== */
+static void usage(void){
+  fprintf(stderr, "usage: kforth_bench [--reps N] [--warmup N] [--only NAME] [--out FILE]\n"
+                  "                    [--baseline FILE] [--threshold PCT] [--root DIR]\n");
+  exit(2);
+}
+
+int main(int argc, char **argv){
+  int reps = 21, warmup = 2;
+  double threshold = 10.0;
+  const char *only = NULL, *out_path = NULL, *baseline = NULL;
+  for(int i=1;i<argc;i++){
+    if(i + 1 >= argc) usage();
+    if(strcmp(argv[i], "--reps") == 0) reps = atoi(argv[++i]);
+    else if(strcmp(argv[i], "--warmup") == 0) warmup = atoi(argv[++i]);
+    else if(strcmp(argv[i], "--only") == 0) only = argv[++i];
+    else if(strcmp(argv[i], "--out") == 0) out_path = argv[++i];
+    else if(strcmp(argv[i], "--baseline") == 0) baseline = argv[++i];
+    else if(strcmp(argv[i], "--threshold") == 0) threshold = atof(argv[++i]);
+    else if(strcmp(argv[i], "--root") == 0) root = argv[++i];
+    else usage();
+  }
+  if(reps < 1) reps = 1;
+  if(warmup < 0) warmup = 0;
+
+  size_t boot_len;
+  char *boot = read_file("bootstrap.fth", &boot_len);
+  kf_vm *core = kf_vm_create(NULL);
+  if(!core){ fprintf(stderr, "kforth-bench: no memory\n"); return 2; }
+  kf_vm *booted = eval_checked(core, boot, boot_len, "bootstrap.fth", NULL);
+
+  FILE *out = out_path ? fopen(out_path, "w") : stdout;
+  if(!out){ fprintf(stderr, "kforth-bench: cannot write %s\n", out_path); return 2; }
+  double *t = (double *)malloc((size_t)reps * sizeof(double));
+  Result res[N_BENCH];
+  int nres = 0;
+  fprintf(out, "{\n  \"reps\": %d,\n  \"warmup\": %d,\n  \"benchmarks\": [\n", reps, warmup);
+
+  for(int b=0;b<N_BENCH;b++){
+    const Bench *bk = &benches[b];
+    if(only && strcmp(only, bk->name) != 0) continue;
+
+    const kf_vm *base = bk->bare ? core : booted;
+    kf_vm *setup = NULL;
+    if(bk->defs){
+      size_t n;
+      char *defs = read_file(bk->defs, &n);
+      setup = eval_checked(base, defs, n, bk->defs, NULL);
+      base = setup;
+      free(defs);
+    }
+    size_t one_len, len;
+    char *one;
+    if(bk->run[0] == '@') one = read_file(bk->run + 1, &one_len);
+    else{ one_len = strlen(bk->run); one = (char *)malloc(one_len + 1); memcpy(one, bk->run, one_len + 1); }
+    len = one_len * (size_t)bk->repeat;
+    char *text = (char *)malloc(len + 1);
+    for(int k=0;k<bk->repeat;k++) memcpy(text + (size_t)k * one_len, one, one_len);
+    text[len] = '\0';
+
+    /* the first run checks the result and counts the cells it executes, the rest are timed into a sink */
+    kf_vm *v = eval_checked(base, text, len, bk->name, bk->expect);
+    uint64_t cells = kf_vm_cells_run(v);   /* a clone starts from 0 */
+    kf_vm_destroy(v);
+    for(int r=-warmup;r<reps;r++){
+      size_t sunk = 0;
+      v = kf_vm_create(base);
+      kf_vm_set_output(v, out_discard, &sunk);
+      double t0 = now_ms();
+      kf_vm_eval(v, text, len);
+      double dt = now_ms() - t0;
+      kf_vm_destroy(v);
+      if(r >= 0) t[r] = dt;
+    }
+    qsort(t, (size_t)reps, sizeof(double), cmp_double);
+    double med = (reps & 1) ? t[reps/2] : (t[reps/2 - 1] + t[reps/2]) / 2.0;
+    int i95 = (reps * 95 + 99) / 100 - 1;
+    double p95 = t[i95 < 0 ? 0 : i95];
+
+    fprintf(out, "%s    {\"name\": \"%s\", \"median_ms\": %.3f, \"p95_ms\": %.3f, \"min_ms\": %.3f",
+            nres ? ",\n" : "", bk->name, med, p95, t[0]);
+    if(cells)
+      fprintf(out, ", \"words\": %llu, \"words_per_sec\": %.0f",
+              (unsigned long long)cells, (double)cells * 1e3 / med);
+    fputc('}', out);
+    fflush(out);
+    res[nres].name = bk->name;
+    res[nres].median = med;
+    res[nres].p95 = p95;
+    nres++;
+
+    free(text);
+    free(one);
+    if(setup) kf_vm_destroy(setup);
+  }
+  fprintf(out, "\n  ]\n}\n");
+  if(out != stdout) fclose(out);
+  free(t);
+  kf_vm_destroy(booted);
+  kf_vm_destroy(core);
+  free(boot);
+
+  if(only && nres == 0){ fprintf(stderr, "kforth-bench: no benchmark named %s\n", only); return 2; }
+  return baseline && compare(baseline, res, nres, threshold) ? 1 : 0;
+}
@@ -0,0 +1,8 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kforth-bench"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang )
+  include(CMakeFiles/kforth-bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
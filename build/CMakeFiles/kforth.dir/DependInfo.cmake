@@ -0,0 +1,21 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/kf_dev.c" "CMakeFiles/kforth.dir/kf_dev.c.o" "gcc" "CMakeFiles/kforth.dir/kf_dev.c.o.d"
+  "/root/repo/kf_io.c" "CMakeFiles/kforth.dir/kf_io.c.o" "gcc" "CMakeFiles/kforth.dir/kf_io.c.o.d"
+  "/root/repo/kforth.c" "CMakeFiles/kforth.dir/kforth.c.o" "gcc" "CMakeFiles/kforth.dir/kforth.c.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
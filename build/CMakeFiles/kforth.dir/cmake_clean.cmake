@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kforth.dir/kf_dev.c.o"
+  "CMakeFiles/kforth.dir/kf_dev.c.o.d"
+  "CMakeFiles/kforth.dir/kf_io.c.o"
+  "CMakeFiles/kforth.dir/kf_io.c.o.d"
+  "CMakeFiles/kforth.dir/kforth.c.o"
+  "CMakeFiles/kforth.dir/kforth.c.o.d"
+  "kforth"
+  "kforth.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/kforth.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
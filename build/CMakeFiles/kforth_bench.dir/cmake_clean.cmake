@@ -0,0 +1,17 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/kforth_bench.dir/bench/kforth_bench.c.o"
+  "CMakeFiles/kforth_bench.dir/bench/kforth_bench.c.o.d"
+  "CMakeFiles/kforth_bench.dir/kf_dev.c.o"
+  "CMakeFiles/kforth_bench.dir/kf_dev.c.o.d"
+  "CMakeFiles/kforth_bench.dir/kf_io.c.o"
+  "CMakeFiles/kforth_bench.dir/kf_io.c.o.d"
+  "CMakeFiles/kforth_bench.dir/kforth.c.o"
+  "CMakeFiles/kforth_bench.dir/kforth.c.o.d"
+  "kforth_bench"
+  "kforth_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/kforth_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -1,4 +1,294 @@
+#if defined(__linux__)
+#define _GNU_SOURCE               /* ptsname_r, cfmakeraw */
+#else
+#define _POSIX_C_SOURCE 200809L   /* clock_gettime, nanosleep */
+#endif
 #include "kf_dev.h"
+#include <time.h>
+
+#if defined(__linux__)
+/*
+ * Handles 1..KF_DEV_HANDLES-1 are file descriptors opened by IO-OPEN: files,
+ * FIFOs, Unix stream sockets (a path naming a socket is connected to) and
+ * ptys (/dev/ptmx, IOCTL 4 opens the other side). All are non-blocking;
+ * IO-WAIT sleeps in epoll until one of them can be read. Handle 0 is left
+ * to the terminal (kf_io), as on the boards.
+ *
+ * The handle table belongs to the process, not to a VM: every VM sees the
+ * same handles, and a handle must not be closed while another VM uses it.
+ * dev_lock guards the table. Each thread waits in its own epoll set and
+ * registers a handle again when its slot has been refilled (dev_gen).
+ *
+ * IOCTL requests:
+ *   0: available bytes  -> y = bytes readable now
+ *   1: flush            -> drain a tty, fsync a file
+ *   2: set baudrate     (x = baud, ttys only) -> y = baud
+ *   3: end of input?    -> y = -1 once a read found the end, else 0
+ *   4: open pty peer    (master from /dev/ptmx) -> y = handle of the raw slave side
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+enum { KF_DEV_HANDLES = 32 };   /* one IO-WAIT mask bit each */
+
+static int dev_fd[KF_DEV_HANDLES];       /* fd + 1, 0: free */
+static uint8_t dev_file[KF_DEV_HANDLES]; /* regular file: always ready, not in epoll */
+static uint8_t dev_eof[KF_DEV_HANDLES];
+static uint32_t dev_gen[KF_DEV_HANDLES]; /* bumped each time the slot is filled */
+static atomic_flag dev_lock = ATOMIC_FLAG_INIT;
+
+static _Thread_local int dev_ep = -1;                      /* this thread's epoll set */
+static _Thread_local uint32_t dev_watch[KF_DEV_HANDLES];   /* dev_gen registered there, 0: none */
+static _Thread_local int dev_wfd[KF_DEV_HANDLES];          /* fd registered for it */
+
+static void dev_enter(void){
+  while(atomic_flag_test_and_set_explicit(&dev_lock, memory_order_acquire)) sched_yield();
+}
+static void dev_leave(void){ atomic_flag_clear_explicit(&dev_lock, memory_order_release); }
+
+static int dev_get(int32_t h){
+  return (h > 0 && h < KF_DEV_HANDLES && dev_fd[h]) ? dev_fd[h] - 1 : -1;
+}
+
+static int dev_add(int fd, int32_t *h){
+  struct stat st;
+  uint8_t file = (uint8_t)(fstat(fd, &st) == 0 && S_ISREG(st.st_mode));
+  dev_enter();
+  for(int32_t i=1;i<KF_DEV_HANDLES;i++){
+    if(dev_fd[i]) continue;
+    dev_fd[i] = fd + 1;
+    dev_file[i] = file;
+    dev_eof[i] = 0;
+    if(++dev_gen[i] == 0) dev_gen[i] = 1;
+    dev_leave();
+    *h = i;
+    return 1;
+  }
+  dev_leave();
+  close(fd);
+  return 0;
+}
+
+static int dev_connect(const char *path){
+  struct sockaddr_un sa;
+  if(strlen(path) >= sizeof(sa.sun_path)) return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if(fd < 0) return -1;
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  strcpy(sa.sun_path, path);
+  if(connect(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0){ close(fd); return -1; }
+  return fd;
+}
+
+int kf_io_open(const char *path, int32_t mode, int32_t *h){
+  static const int acc[4] = { O_RDONLY, O_WRONLY, O_RDWR, O_RDWR };
+  struct stat st;
+  int fd;
+  *h = 0;
+  if(stat(path, &st) == 0 && S_ISSOCK(st.st_mode)){
+    fd = dev_connect(path);
+  }else{
+    int fl = acc[mode & 3] | O_NONBLOCK | O_CLOEXEC | O_NOCTTY;
+    if(mode & 4) fl |= O_CREAT | O_TRUNC;
+    if(mode & 8) fl |= O_CREAT | O_APPEND;
+    fd = open(path, fl, 0666);
+  }
+  return fd >= 0 && dev_add(fd, h);
+}
+
+int kf_io_close(int32_t h){
+  dev_enter();
+  int fd = dev_get(h);
+  if(fd >= 0) dev_fd[h] = 0;
+  dev_leave();
+  if(fd < 0) return 0;
+  if(dev_watch[h]){   /* other threads' sets drop the fd when it closes */
+    epoll_ctl(dev_ep, EPOLL_CTL_DEL, fd, NULL);
+    dev_watch[h] = 0;
+  }
+  return close(fd) == 0;
+}
+
+int kf_io_read(int32_t h, uint8_t *buf, int32_t len, int32_t *n){
+  int fd = dev_get(h);
+  *n = 0;
+  if(fd < 0 || len < 0) return 0;
+  ssize_t r;
+  do r = read(fd, buf, (size_t)len); while(r < 0 && errno == EINTR);
+  if(r < 0) return errno == EAGAIN;
+  if(r == 0 && len > 0){ dev_eof[h] = 1; return 0; }
+  *n = (int32_t)r;
+  return 1;
+}
+
+int kf_io_write(int32_t h, const uint8_t *buf, int32_t len, int32_t *n){
+  int fd = dev_get(h);
+  *n = 0;
+  if(fd < 0 || len < 0) return 0;
+  ssize_t r;
+  do r = write(fd, buf, (size_t)len); while(r < 0 && errno == EINTR);
+  if(r < 0) return errno == EAGAIN;
+  *n = (int32_t)r;
+  return 1;
+}
+
+int kf_io_at(int32_t h, int32_t *bout){
+  uint8_t b;
+  int32_t n;
+  *bout = 0;
+  if(!kf_io_read(h, &b, 1, &n) || n != 1) return 0;
+  *bout = b;
+  return 1;
+}
+
+int kf_io_put(int32_t h, int32_t b){
+  uint8_t c = (uint8_t)b;
+  int32_t n;
+  return kf_io_write(h, &c, 1, &n) && n == 1;
+}
+
+/* pty master: unlock it and open its slave side in raw mode */
+static int dev_pty_peer(int fd, int32_t *y){
+  char name[64];
+  struct termios t;
+  if(grantpt(fd) != 0 || unlockpt(fd) != 0 || ptsname_r(fd, name, sizeof(name)) != 0) return 0;
+  int s = open(name, O_RDWR | O_NONBLOCK | O_CLOEXEC | O_NOCTTY);
+  if(s < 0) return 0;
+  if(tcgetattr(s, &t) == 0){
+    cfmakeraw(&t);
+    tcsetattr(s, TCSANOW, &t);
+  }
+  return dev_add(s, y);
+}
+
+static int dev_baud(int fd, int32_t x){
+  static const struct { int32_t baud; speed_t sp; } rates[] = {
+    { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 },
+    { 115200, B115200 }, { 230400, B230400 }
+  };
+  struct termios t;
+  for(size_t i=0;i<sizeof(rates)/sizeof(rates[0]);i++){
+    if(rates[i].baud != x) continue;
+    return tcgetattr(fd, &t) == 0 && cfsetspeed(&t, rates[i].sp) == 0 && tcsetattr(fd, TCSANOW, &t) == 0;
+  }
+  return 0;
+}
+
+int kf_io_ctl(int32_t h, int32_t req, int32_t x, int32_t *y){
+  int fd = dev_get(h);
+  int n = 0;
+  *y = 0;
+  if(fd < 0) return 0;
+  switch(req){
+    case 0:
+      if(dev_file[h]){
+        struct stat st;
+        off_t at = lseek(fd, 0, SEEK_CUR);
+        if(fstat(fd, &st) != 0 || at < 0) return 0;
+        *y = st.st_size > at ? (int32_t)(st.st_size - at) : 0;
+        return 1;
+      }
+      if(ioctl(fd, FIONREAD, &n) != 0) return 0;
+      *y = n;
+      return 1;
+    case 1:
+      return isatty(fd) ? tcdrain(fd) == 0 : dev_file[h] ? fsync(fd) == 0 : 1;
+    case 2:
+      if(!dev_baud(fd, x)) return 0;
+      *y = x;
+      return 1;
+    case 3:
+      *y = dev_eof[h] ? -1 : 0;
+      return 1;
+    case 4:
+      return dev_pty_peer(fd, y);
+    default:
+      return 0;
+  }
+}
+
+/* handles in mask that can be read without waiting; timeout_ms < 0 waits forever */
+int kf_io_wait(uint32_t mask, int32_t timeout_ms, uint32_t *ready){
+  struct epoll_event ev[KF_DEV_HANDLES];
+  uint32_t r = 0;
+  *ready = 0;
+  if(dev_ep < 0 && (dev_ep = epoll_create1(EPOLL_CLOEXEC)) < 0) return 0;
+  dev_enter();
+  for(int32_t h=1;h<KF_DEV_HANDLES;h++){
+    int fd = dev_fd[h] - 1;
+    uint32_t want = (fd >= 0 && (mask >> h & 1u)) ? dev_gen[h] : 0;
+    if(want && (dev_file[h] || dev_eof[h])){ r |= 1u << h; continue; }
+    if(want == dev_watch[h]) continue;
+    if(dev_watch[h]){
+      int live = 0;   /* a closed fd may already be back as another handle */
+      for(int32_t j=1;j<KF_DEV_HANDLES;j++) live |= j != h && dev_fd[j] - 1 == dev_wfd[h];
+      if(!live) epoll_ctl(dev_ep, EPOLL_CTL_DEL, dev_wfd[h], NULL);
+      dev_watch[h] = 0;
+    }
+    if(!want) continue;
+    struct epoll_event e = { EPOLLIN, { .u32 = (uint32_t)h } };
+    if(epoll_ctl(dev_ep, EPOLL_CTL_ADD, fd, &e) == 0 ||
+       (errno == EEXIST && epoll_ctl(dev_ep, EPOLL_CTL_MOD, fd, &e) == 0)){
+      dev_watch[h] = want;
+      dev_wfd[h] = fd;
+    }
+  }
+  dev_leave();
+  int k;
+  do k = epoll_wait(dev_ep, ev, KF_DEV_HANDLES, r ? 0 : timeout_ms); while(k < 0 && errno == EINTR);
+  if(k < 0) return 0;
+  for(int i=0;i<k;i++) r |= 1u << ev[i].data.u32;
+  *ready = r & mask;
+  return 1;
+}
+
+#else
+int kf_io_open(const char *path, int32_t mode, int32_t *h){
+  (void)path;
+  (void)mode;
+  *h = 0;
+  return 0;
+}
+
+int kf_io_close(int32_t h){
+  (void)h;
+  return 0;
+}
+
+int kf_io_read(int32_t h, uint8_t *buf, int32_t len, int32_t *n){
+  (void)h;
+  (void)buf;
+  (void)len;
+  *n = 0;
+  return 0;
+}
+
+int kf_io_write(int32_t h, const uint8_t *buf, int32_t len, int32_t *n){
+  (void)h;
+  (void)buf;
+  (void)len;
+  *n = 0;
+  return 0;
+}
+
+int kf_io_wait(uint32_t mask, int32_t timeout_ms, uint32_t *ready){
+  (void)mask;
+  (void)timeout_ms;
+  *ready = 0;
+  return 0;
+}
 
 int kf_io_at(int32_t h, int32_t *bout){
   (void)h;
@@ -19,3 +309,15 @@ int kf_io_ctl(int32_t h, int32_t req, int32_t x, int32_t *y){
   if(y) *y = 0;
   return 0;
 }
+#endif
+
+uint32_t kf_ms(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u);
+}
+
+void kf_idle(void){
+  struct timespec ts = { 0, 1000000 };
+  nanosleep(&ts, NULL);
+}
@@ -10,5 +10,15 @@
 int kf_io_at(int32_t h, int32_t *bout);                 /* IO@   ( h -- b f ) */
 int kf_io_put(int32_t h, int32_t b);                    /* IO!   ( b h -- f ) */
 int kf_io_ctl(int32_t h, int32_t req, int32_t x, int32_t *y); /* IOCTL ( x req h -- y f ) */
+int kf_io_open(const char *path, int32_t mode, int32_t *h);   /* IO-OPEN ( addr len mode -- h f ) */
+int kf_io_close(int32_t h);                                    /* IO-CLOSE ( h -- f ) */
+/* READ-BLOCK / WRITE-BLOCK ( addr len h -- n f ): *n bytes moved, 0 if the device would block */
+int kf_io_read(int32_t h, uint8_t *buf, int32_t len, int32_t *n);
+int kf_io_write(int32_t h, const uint8_t *buf, int32_t len, int32_t *n);
+/* IO-WAIT ( mask timeout -- ready ): handles (bit h) readable without blocking */
+int kf_io_wait(uint32_t mask, int32_t timeout_ms, uint32_t *ready);
+
+uint32_t kf_ms(void);     /* free-running millisecond clock (MS, sleeping tasks) */
+void kf_idle(void);       /* no task can run: wait about a millisecond */
 
 #endif
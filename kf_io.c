@@ -1,13 +1,104 @@
 #include "kf_io.h"
+#include <errno.h>
+#include <poll.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* output is collected here and written at flush points, not per byte */
+#ifndef KF_IO_OUTBUF
+#define KF_IO_OUTBUF 4096
+#endif
+
+static uint8_t out_buf[KF_IO_OUTBUF];
+static size_t out_n = 0;
+
+void mf_flush(void){
+  if(out_n){
+    fwrite(out_buf, 1, out_n, stdout);
+    out_n = 0;
+  }
+  fflush(stdout);
+}
+
+/* input: a regular-file stdin is mapped whole, anything else is read() in blocks */
+#ifndef KF_IO_INBUF
+#define KF_IO_INBUF 65536
+#endif
+
+enum { IN_START, IN_MAPPED, IN_READ, IN_EOF };
+static int in_state = IN_START;
+static uint8_t in_buf[KF_IO_INBUF];
+static const uint8_t *in_p = in_buf;
+static const uint8_t *in_end = in_buf;
+
+static void in_map(void){
+  struct stat st;
+  off_t off = lseek(0, 0, SEEK_CUR);
+  in_state = IN_READ;
+  if(off < 0 || fstat(0, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= off) return;
+  void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, 0, 0);
+  if(m == MAP_FAILED) return;
+  in_p = (const uint8_t *)m + off;
+  in_end = (const uint8_t *)m + st.st_size;
+  in_state = IN_MAPPED;
+}
+
+static void in_refill(void){
+  if(in_state == IN_START){
+    in_map();
+    if(in_state == IN_MAPPED) return;
+  }
+  if(in_state != IN_READ){ in_state = IN_EOF; return; }
+  mf_flush();
+  ssize_t r;
+  do r = read(0, in_buf, sizeof(in_buf)); while(r < 0 && errno == EINTR);
+  if(r <= 0){ in_state = IN_EOF; return; }
+  in_p = in_buf;
+  in_end = in_buf + r;
+}
+
+const uint8_t *mf_in_window(size_t *len){
+  if(in_p == in_end && in_state != IN_EOF) in_refill();
+  *len = (size_t)(in_end - in_p);
+  return in_p;
+}
+
+int mf_key_ready(void){
+  if(in_state == IN_START) in_map();
+  if(in_p != in_end || in_state != IN_READ) return 1;
+  struct pollfd p = { 0, POLLIN, 0 };
+  return poll(&p, 1, 0) != 0;
+}
+
+void mf_in_consume(size_t n){
+  in_p += n;
+}
 
 int mf_key(void){
-  int c = getchar();
-  if(c == EOF) return -1;
-  return c & 0xFF;
+  size_t n;
+  const uint8_t *p = mf_in_window(&n);
+  if(n == 0) return -1;
+  in_p++;
+  return *p;
 }
 
 void mf_emit(uint8_t ch){
-  putchar((int)ch);
-  fflush(stdout);
+  if(out_n == sizeof(out_buf)) mf_flush();
+  out_buf[out_n++] = ch;
+}
+
+void mf_write(const uint8_t *buf, size_t len){
+  if(len > sizeof(out_buf) - out_n){
+    mf_flush();
+    if(len >= sizeof(out_buf)){
+      fwrite(buf, 1, len, stdout);
+      fflush(stdout);
+      return;
+    }
+  }
+  memcpy(out_buf + out_n, buf, len);
+  out_n += len;
 }
@@ -1,12 +1,32 @@
 #ifndef KF_IO_H
 #define KF_IO_H
 
+#include <stddef.h>
 #include <stdint.h>
 
-/* blocking read: return 0..255, or -1 on EOF */
+/* blocking read: return 0..255, or -1 on EOF; pending output is flushed first */
 int mf_key(void);
 
+/*
+  buffered input window: *len unread bytes at the returned pointer, refilled
+  (blocking, after a flush) only when empty; *len == 0 at EOF. The bytes stay
+  valid until the next call that has to refill.
+*/
+const uint8_t *mf_in_window(size_t *len);
+
+/* 1 if mf_key()/mf_in_window() would return without waiting (data or EOF) */
+int mf_key_ready(void);
+
+/* mark n bytes of the current window as read */
+void mf_in_consume(size_t n);
+
 /* output one byte */
 void mf_emit(uint8_t ch);
 
+/* output len bytes */
+void mf_write(const uint8_t *buf, size_t len);
+
+/* push buffered output to the device */
+void mf_flush(void);
+
 #endif
@@ -6,11 +6,21 @@
 
   Run (bootstrap + then REPL continues on stdin):
     cat bootstrap.fth - | ./kforth
+
+  Or start from an image saved after bootstrap:
+    printf 'S" boot.img" SAVE-IMAGE BYE\n' | cat bootstrap.fth - | ./kforth
+    ./kforth --image boot.img
+
+  Cap the regions of one run (also KFORTH_CODE_CELLS etc. in the environment):
+    cat bootstrap.fth - | ./kforth --code-cells 65536 --data-cells 65536 --dict-words 4096
+
+  Profile (-DKFORTH_PROFILE=1), folded stacks written at exit:
+    cat bootstrap.fth app.fth | ./kforth --profile app.folded
 */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdint.h>
 #include <setjmp.h>
 
@@ -21,11 +31,23 @@
 typedef int32_t  cell;
 typedef uint32_t ucell;
 
+/*
+  Region maxima. Linux hosts reserve large ones: VMs are mapped with
+  MAP_NORESERVE, so a page costs memory only once touched, and
+  --code-cells --data-cells --dict-words cap what one run may fill.
+*/
+#if defined(__linux__) && !defined(ARDUINO)
+#  define KF_MEM_DEFAULT 1048576
+#  define KF_DICT_DEFAULT 16384
+#else
+#  define KF_MEM_DEFAULT 32768
+#  define KF_DICT_DEFAULT 2048
+#endif
 #ifndef KFORTH_MEM_CODE_CELLS
-#define KFORTH_MEM_CODE_CELLS 32768
+#define KFORTH_MEM_CODE_CELLS KF_MEM_DEFAULT
 #endif
 #ifndef KFORTH_MEM_DATA_CELLS
-#define KFORTH_MEM_DATA_CELLS 32768
+#define KFORTH_MEM_DATA_CELLS KF_MEM_DEFAULT
 #endif
 #ifndef KFORTH_DS_DEPTH
 #define KFORTH_DS_DEPTH 256
@@ -34,14 +56,147 @@ typedef uint32_t ucell;
 #define KFORTH_RS_DEPTH 256
 #endif
 #ifndef KFORTH_DICT_MAX
-#define KFORTH_DICT_MAX 2048
+#define KFORTH_DICT_MAX KF_DICT_DEFAULT
+#endif
+/* ring for strings made in interpret state (S" and PARSE past the line), in bytes */
+#ifndef KFORTH_TRANSIENT_BYTES
+#define KFORTH_TRANSIENT_BYTES 512
+#endif
+/* cells at the top of data space kept for ALLOCATE/FREE/RESIZE (0: no heap) */
+#ifndef KFORTH_HEAP_CELLS
+#define KFORTH_HEAP_CELLS (KFORTH_MEM_DATA_CELLS / 4)
+#endif
+#if KFORTH_HEAP_CELLS >= KFORTH_MEM_DATA_CELLS
+#error "KFORTH_HEAP_CELLS must leave data space for the dictionary"
+#endif
+#ifndef KFORTH_DICT_HASH
+#define KFORTH_DICT_HASH 256     /* name index buckets, power of two */
+#endif
+/* 1: computed-goto inner interpreter (GCC/Clang), 0: portable call-threaded loop */
+#ifndef KFORTH_DIRECT_THREADED
+#  if defined(__GNUC__)
+#    define KFORTH_DIRECT_THREADED 1
+#  else
+#    define KFORTH_DIRECT_THREADED 0
+#  endif
+#endif
+#if KFORTH_DIRECT_THREADED && !defined(__GNUC__)
+#error "KFORTH_DIRECT_THREADED needs GCC/Clang labels-as-values"
+#endif
+/* keep the top data-stack cell in a register inside the direct-threaded loop */
+#ifndef KFORTH_TOS_CACHE
+#define KFORTH_TOS_CACHE KFORTH_DIRECT_THREADED
+#endif
+#if KFORTH_TOS_CACHE && !KFORTH_DIRECT_THREADED
+#error "KFORTH_TOS_CACHE needs KFORTH_DIRECT_THREADED"
+#endif
+/* rewrite common cell sequences into superinstructions at ; */
+#ifndef KFORTH_PEEPHOLE
+#define KFORTH_PEEPHOLE 1
+#endif
+/* inline branch-free colon words up to this many cells at ; (0 = off) */
+#ifndef KFORTH_INLINE_CELLS
+#define KFORTH_INLINE_CELLS 8
+#endif
+/* kf_vm_create() and friends: many VMs per process, each run by one thread at a time */
+#ifndef KFORTH_MULTI_VM
+#  if defined(ARDUINO)
+#    define KFORTH_MULTI_VM 0
+#  else
+#    define KFORTH_MULTI_VM 1
+#  endif
+#endif
+#if KFORTH_MULTI_VM
+#  define KF_THREAD_LOCAL _Thread_local
+#else
+#  define KF_THREAD_LOCAL
+#endif
+/* PROFILE-ON/-OFF/-RESET/-REPORT and --profile; 0 compiles the hooks out */
+#ifndef KFORTH_PROFILE
+#define KFORTH_PROFILE 0
+#endif
+/* count the cells each VM executes, for kforth-bench (kf_vm_cells_run); 0 compiles it out */
+#ifndef KFORTH_COUNT_CELLS
+#define KFORTH_COUNT_CELLS 0
+#endif
+/* compile hot colon words to native code (x86-64 Linux, direct-threaded engine) */
+#ifndef KFORTH_JIT
+#define KFORTH_JIT 0
+#endif
+#if KFORTH_JIT && !(defined(__x86_64__) && defined(__linux__) && KFORTH_DIRECT_THREADED)
+#  undef KFORTH_JIT
+#  define KFORTH_JIT 0   /* other targets keep the interpreter */
+#endif
+/* calls before a colon word is compiled to native code */
+#ifndef KFORTH_JIT_HOT
+#define KFORTH_JIT_HOT 2
+#endif
+/* float32 arithmetic in C; 0 leaves it to the Forth code in bootstrap.fth */
+#ifndef KFORTH_NATIVE_FLOAT
+#define KFORTH_NATIVE_FLOAT 1
+#endif
+/* SAVE-IMAGE and --image (needs stdio files) */
+#ifndef KFORTH_IMAGE
+#  if defined(ARDUINO)
+#    define KFORTH_IMAGE 0
+#  else
+#    define KFORTH_IMAGE 1
+#  endif
+#endif
+/* SAVE-C: write the loaded dictionary as C source for a standalone binary */
+#ifndef KFORTH_SAVE_C
+#  if defined(ARDUINO)
+#    define KFORTH_SAVE_C 0
+#  else
+#    define KFORTH_SAVE_C 1
+#  endif
+#endif
+/* TASK ACTIVATE PAUSE STOP MS USER: cooperative tasks run by the terminal's interpreter */
+#ifndef KFORTH_TASKS
+#define KFORTH_TASKS 1
+#endif
+#ifndef KFORTH_TASKS_MAX
+#define KFORTH_TASKS_MAX 8       /* tasks activated at once */
+#endif
+#ifndef KFORTH_TASK_STACK
+#define KFORTH_TASK_STACK 32     /* cells of each stack a task may hold when it pauses */
+#endif
+#ifndef KFORTH_TASK_USER
+#define KFORTH_TASK_USER 16      /* USER variables per task */
+#endif
+/* OPEN-FILE READ-LINE MAP-FILE etc.: host files through stdio (MAP-FILE needs mmap) */
+#ifndef KFORTH_FILES
+#  if defined(ARDUINO)
+#    define KFORTH_FILES 0
+#  else
+#    define KFORTH_FILES 1
+#  endif
+#endif
+#ifndef KFORTH_FILES_MAX
+#define KFORTH_FILES_MAX 8       /* files open at once */
+#endif
+#ifndef KFORTH_FILE_BUF
+#define KFORTH_FILE_BUF 65536    /* stdio buffer of each open file */
+#endif
+/* set by SAVE-C output, which includes this file and runs the saved application */
+#ifndef KFORTH_APP
+#define KFORTH_APP 0
 #endif
 
 enum { MEM_CODE_CELLS = KFORTH_MEM_CODE_CELLS, MEM_DATA_CELLS = KFORTH_MEM_DATA_CELLS };
+enum { HEAP_CELLS = KFORTH_HEAP_CELLS, DATA_TOP = MEM_DATA_CELLS - HEAP_CELLS };   /* HERE stays below DATA_TOP */
+enum { HEAP_CLASSES = 4 };
 enum { DS_DEPTH = KFORTH_DS_DEPTH, RS_DEPTH = KFORTH_RS_DEPTH };
 enum { NAME_MAX = 15 };
 enum { DICT_MAX = KFORTH_DICT_MAX };
+enum { DICT_HASH = KFORTH_DICT_HASH };
 enum { PRIM_MAX = 256 };
+#if KFORTH_TASKS
+enum { TASKS_MAX = KFORTH_TASKS_MAX, TASK_STACK = KFORTH_TASK_STACK, TASK_USER = KFORTH_TASK_USER };
+#endif
+#if KFORTH_FILES
+enum { FILES_MAX = KFORTH_FILES_MAX };
+#endif
 enum { CELL_BITS = (int)(sizeof(cell) * 8), CELL_BYTES = (int)sizeof(cell) };
 
 #define WORD_TAG      0x80000000u
@@ -49,39 +204,160 @@ enum { CELL_BITS = (int)(sizeof(cell) * 8), CELL_BYTES = (int)sizeof(cell) };
 #define WORD_ID(x)    ((int)((ucell)(x) & 0x7FFFFFFFu))
 #define MK_WORDTOK(i) ((cell)(WORD_TAG | (ucell)(i)))
 
-/* ===== VM state ===== */
-static cell  code_mem[MEM_CODE_CELLS];
-static cell  data_mem[MEM_DATA_CELLS];
-static ucell here_code = 0;
-static ucell here_data = 0;
-
-static cell DS[DS_DEPTH];
-static int  dsp = 0;
-static cell RS[RS_DEPTH];
-static int  rsp = 0;
-
-static ucell ip = 0;
-static int   running = 0;
-
 /* ===== dictionary ===== */
 typedef struct Word {
   int     link;
+  int     hnext;     /* next older word in the same name-hash bucket */
+  uint32_t hash;     /* name_hash() of name */
   char    name[NAME_MAX+1];
+  uint8_t len;       /* strlen(name) */
   uint8_t immediate;
+  uint8_t noinline;  /* never copy this body into callers */
 
   ucell   cfa;       /* primitive xt */
   ucell   pfa;       /* DOCOL: code addr, DOVAR/DODOES: data cell addr */
   ucell   does_ip;   /* DODOES: code addr */
 } Word;
 
-static Word dict[DICT_MAX];
-static int  dict_n = 0;
-static int  latest = -1;
+#if KFORTH_PROFILE
+/* call-tree node: one (caller path, word) pair */
+typedef struct ProfNode {
+  int      parent;   /* -1 for the root (outer interpreter) */
+  int      wi;
+  uint64_t self;     /* cells executed as this word under this path */
+  uint64_t calls;
+} ProfNode;
+enum { PROF_NODES = 4096, PROF_HASH = 8192 };
+#endif
+
+#if KFORTH_JIT
+typedef void (*jit_entry)(kf_vm *);
+enum { JIT_UNITS = 1024, JIT_MAX_CELLS = 2048, JIT_ARENA = 4 << 20 };
+typedef struct JitUnit {
+  ucell entry;     /* body start: pfa or does_ip */
+  ucell lo, hi;    /* code cells the native code was built from */
+  jit_entry code;
+} JitUnit;
+#endif
+
+/* ===== VM state ===== */
+/*
+  Everything one interpreter owns. Primitives reach it through `vm`, the
+  VM running on the calling thread; the primitive table and XT_ and WI_
+  indices below are shared by all VMs and fixed once the first core is built.
+*/
+struct kf_vm {
+  cell  code_mem[MEM_CODE_CELLS];
+  cell  data_mem[MEM_DATA_CELLS];
+  ucell here_code;
+  ucell here_data;
+  ucell code_max, data_max;        /* here_code/here_data limits of this run */
+
+  int   heap_ready;                /* data_mem[DATA_TOP..] holds the heap's blocks */
+  ucell heap_small[HEAP_CLASSES];  /* freed small blocks by size class, 0: none */
+  ucell heap_free;                 /* free large blocks, doubly linked, 0: none */
+  ucell heap_used, heap_high;      /* cells in allocated blocks, and the most ever */
+  ucell trans_at;                  /* next free byte of the transient string ring */
+
+  cell  DS_mem[DS_DEPTH + 1];   /* DS_mem[0]: scratch cell below the stack */
+  cell *DS;                     /* DS_mem + 1 */
+  int   dsp;
+  cell  RS[RS_DEPTH];
+  int   rsp;
+
+  ucell ip;
+  int   running;
+  int   rs_base;   /* EXIT back to this RS depth ends run_thread() */
+
+  Word  dict[DICT_MAX];
+  int   dict_n;
+  int   dict_max;                  /* dict_n limit of this run */
+  int   latest;
+  int   dict_hash[DICT_HASH];  /* bucket -> newest word, -1 if empty */
+
+  int   last_created;
+  int   current_wi;
+  int   compiling;
+  int   current_def;
+  struct { ucell here_code, here_data; int dict_n, latest, last_created; } def_mark;   /* as : found them */
+  cell  leave_link;       /* newest (?DO)/(LEAVE) operand awaiting the loop end; -1 none, -2 not in DO */
+  int   inline_on;
+
+  jmp_buf recover_env;
+  int   recover_active;
+  int   recover_requested;
+  jmp_buf exit_env;       /* BYE and fatal errors end kf_vm_run()/kf_vm_eval() here */
+  int   exit_active;
+  int   exit_status;
+
+  /* input: the terminal (kf_io) unless src is set */
+  const uint8_t *src;
+  const uint8_t *src_end;
+  int   prompt_mode;
+  int   token_end_delim;
+  char  tok_join[128];   /* a token cut by a refill is assembled here */
+
+  /* output: the terminal unless out_fn is set */
+  kf_out_fn out_fn;
+  void *out_ctx;
+  size_t out_n;
+  uint8_t out_buf[256];
+
+#if KFORTH_PROFILE
+  int   prof_on;
+  int   prof_n;                     /* nodes in use, node 0 is the root */
+  int   prof_sp;
+  struct { int node; int rdepth; } prof_frame[RS_DEPTH + 1];
+  int   prof_hash[PROF_HASH];       /* (parent, wi) -> node + 1, 0 empty */
+  ProfNode prof_node[PROF_NODES];
+#endif
+
+#if KFORTH_COUNT_CELLS
+  uint64_t cells_run;              /* cells dispatched by run_thread(); native JIT code is not counted */
+#endif
+
+#if KFORTH_JIT
+  int   jit_on;
+  int   jit_active;                /* native frames entered from the interpreter */
+  jit_entry jit_fn[DICT_MAX];      /* native body of a DOCOL/DODOES word, or NULL */
+  uint32_t jit_hits[DICT_MAX];
+  uint8_t jit_dep[DICT_MAX];       /* native code assumes this word's cfa/does_ip */
+  int   jit_units;
+  ucell jit_lo, jit_hi;            /* code range covered by live units */
+  JitUnit jit_unit[JIT_UNITS];
+  uint8_t jit_dead[JIT_UNITS];     /* checked by native code after every call */
+  uint8_t *jit_mem;                /* code arena, mapped on first use */
+  size_t jit_used;
+#endif
+
+#if KFORTH_TASKS
+  ucell task_blk[TASKS_MAX];       /* TASK blocks activated so far */
+  int   task_n;
+  int   task_cur;                  /* running task's index, -1: the operator */
+  int   task_yield;                /* the task stopped run_thread() to give up the CPU */
+  jmp_buf task_env;                /* an error in the running task lands in task_run() */
+  ucell task_up;                   /* user area of the running task */
+  cell  task_ds[DS_DEPTH];         /* the operator's stacks while a task runs */
+  cell  task_rs[RS_DEPTH];
+#endif
+
+#if KFORTH_FILES
+  FILE *file[FILES_MAX];           /* fileid i + 1 */
+  const uint8_t *map_mem;          /* MAP-FILE window, read at byte address MAP_BASE */
+  size_t map_len;
+#endif
+};
+
+#if KFORTH_MULTI_VM
+static KF_THREAD_LOCAL kf_vm *vm;
+#else
+static kf_vm vm_main;
+static kf_vm * const vm = &vm_main;
+#endif
 
-static int last_created = -1;
-static int current_wi = -1;
-static int compiling = 0;
-static int current_def = -1;
+/* limits given to new VMs; the host's --code-cells etc. lower them before the first */
+static ucell lim_code = MEM_CODE_CELLS, lim_data = DATA_TOP;
+static int lim_dict = DICT_MAX;
 
 /* ===== primitive table ===== */
 typedef void (*prim_fn)(void);
@@ -90,29 +366,157 @@ static int prim_n = 0;
 
 static ucell XT_EXIT, XT_LIT, XT_BRANCH, XT_0BRANCH;
 static ucell XT_DOCOL, XT_DOVAR, XT_DODOES;
-static ucell XT_DO, XT_LOOP, XT_PLOOP;
+static ucell XT_DO, XT_LOOP, XT_PLOOP, XT_XQDO, XT_XLEAVE;
 static ucell XT_XPOSTPONE, XT_XDOES;
+static ucell XT_TOR, XT_RFROM, XT_RAT, XT_I, XT_J, XT_UNLOOP, XT_EXECUTE;
+static ucell XT_DUP, XT_DROP, XT_SWAP, XT_OVER, XT_ADD, XT_SUB, XT_AND, XT_OR, XT_XOR, XT_ZEQ, XT_0LT;
+static ucell XT_FETCH, XT_STORE, XT_LSHIFT, XT_RSHIFT;
+static ucell XT_LITADD, XT_LITAND, XT_LITLSHIFT, XT_LITRSHIFT;
+static ucell XT_LITFETCH, XT_LITSTORE, XT_DUP0BRANCH, XT_ZEQ0BRANCH, XT_2DUP, XT_TAIL;
+static ucell XT_IADD, XT_IADDFETCH;
+#if KFORTH_TASKS
+static ucell XT_KEY, XT_IOWAIT, XT_ACTIVATE, XT_DOUSER;
+#endif
 static int WI_LIT = -1, WI_TYPE = -1, WI_ABORTQ = -1;
 
 static void p_ABORT(void);
 static void compile_wordtok(int wi);
+#if KFORTH_INLINE_CELLS || KFORTH_PEEPHOLE
+static int code_owner(ucell a);
+#endif
+#if KFORTH_PEEPHOLE
+static void untail(ucell a);
+#endif
 static void execute_wi(int wi);
+#if KFORTH_JIT
+static void jit_invalidate(ucell a);
+static void jit_flush(void);
+#endif
+
+#if KFORTH_APP
+/* ===== SAVE-C application: saved words and their C bodies ===== */
+typedef void (*app_fn)(void);
+typedef struct AppWord {
+  ucell   cfa, pfa, does_ip;
+  uint8_t immediate, noinline;
+  app_fn  fn;          /* C body from pfa (DOCOL) or does_ip (DODOES), or NULL */
+} AppWord;
+typedef struct AppImage {
+  uint32_t build_id;
+  ucell    here_code, here_data;
+  int      core_n, dict_n;   /* dict[core_n, dict_n) comes from words[] */
+  int      latest, last_created, entry;
+  const cell    *code;
+  const cell    *data;
+  const AppWord *words;
+} AppImage;
+static const AppImage app_image;   /* defined by the generated source after this file */
+static int app_stale;              /* CODE! changed saved code: C bodies no longer match */
+
+/* C body for a call of wi, if its definition is still the saved one */
+static app_fn app_word(int wi){
+  if(app_stale || wi < app_image.core_n || wi >= app_image.dict_n) return NULL;
+  const AppWord *a = &app_image.words[wi - app_image.core_n];
+  const Word *w = &vm->dict[wi];
+  if(!a->fn || w->cfa != a->cfa || (w->cfa == XT_DODOES && w->does_ip != a->does_ip)) return NULL;
+  return a->fn;
+}
+/*
+  C bodies keep the data stack pointer in a local (sp over ds) and store it
+  back around every call. APP_BAIL resumes interpreting at cell a, so a
+  failed check is reported by the interpreter as usual; APP_CHECK leaves
+  when a call did not return to next.
+*/
+#define APP_ENTER()        cell *const ds = vm->DS; int sp = vm->dsp; (void)ds
+#define APP_BAIL(a)        do{ vm->dsp = sp; vm->ip = (a); return; }while(0)
+#define APP_NEED(n, a)     do{ if(sp < (n)) APP_BAIL(a); }while(0)
+#define APP_ROOM(n, a)     do{ if(sp > DS_DEPTH - (n)) APP_BAIL(a); }while(0)
+#define APP_STATE(a)       do{ if(vm->data_mem[A_STATE] != 0) APP_BAIL(a); }while(0)
+#define APP_CHECK(next)    do{ if(vm->ip != (next) || !vm->running || app_stale) return; }while(0)
+#define APP_PLAIN(f)       do{ vm->dsp = sp; f(); sp = vm->dsp; }while(0)
+#define APP_PRIM(f, at, next) do{ vm->dsp = sp; vm->ip = (at); f(); sp = vm->dsp; APP_CHECK(next); }while(0)
+#define APP_EXIT()         do{ vm->dsp = sp; p_EXIT(); return; }while(0)
+
+/* in C bodies: a word called the way the interpreter would call it */
+static void app_call(int wi, ucell ret){
+  vm->current_wi = wi;
+  vm->ip = ret;
+  prim_table[vm->dict[wi].cfa]();
+}
+#endif
+
+/* ===== per-VM I/O: the kf_io terminal, or a source buffer and out_fn ===== */
+/* the terminal's buffers are process-wide: one VM at a time may use them (kforth_api.h) */
+static void vm_flush(void){
+  if(!vm->out_fn){ mf_flush(); return; }
+  if(vm->out_n){
+    vm->out_fn(vm->out_ctx, vm->out_buf, vm->out_n);
+    vm->out_n = 0;
+  }
+}
+static void vm_emit(uint8_t ch){
+  if(!vm->out_fn){ mf_emit(ch); return; }
+  if(vm->out_n == sizeof(vm->out_buf)) vm_flush();
+  vm->out_buf[vm->out_n++] = ch;
+}
+static void vm_write(const uint8_t *buf, size_t len){
+  if(!vm->out_fn){ mf_write(buf, len); return; }
+  if(len > sizeof(vm->out_buf) - vm->out_n){
+    vm_flush();
+    if(len >= sizeof(vm->out_buf)){ vm->out_fn(vm->out_ctx, buf, len); return; }
+  }
+  memcpy(vm->out_buf + vm->out_n, buf, len);
+  vm->out_n += len;
+}
+#if KFORTH_TASKS
+static void task_wait_input(void);
+#endif
+static const uint8_t *vm_in_window(size_t *len){
+  if(!vm->src){
+#if KFORTH_TASKS
+    if(vm->task_n) task_wait_input();
+#endif
+    return mf_in_window(len);
+  }
+  *len = (size_t)(vm->src_end - vm->src);
+  return vm->src;
+}
+static void vm_in_consume(size_t n){
+  if(vm->src) vm->src += n;
+  else mf_in_consume(n);
+}
+static int vm_key(void){
+  if(!vm->src){
+#if KFORTH_TASKS
+    if(vm->task_n) task_wait_input();
+#endif
+    return mf_key();
+  }
+  if(vm->src == vm->src_end) return -1;
+  return *vm->src++;
+}
 
-static jmp_buf recover_env;
-static int recover_active = 0;
-static int recover_requested = 0;
+/* BYE and fatal errors: end this VM's run, or the process outside one */
+static _Noreturn void vm_exit(int status){
+  vm_flush();
+  if(vm->exit_active){
+    vm->exit_status = status;
+    longjmp(vm->exit_env, 1);
+  }
+  exit(status);
+}
 
-static void out_ch(char c){ mf_emit((uint8_t)c); }
-static void out_str(const char *s){ while(*s) out_ch(*s++); }
+static void out_ch(char c){ vm_emit((uint8_t)c); }
+static void out_str(const char *s){ vm_write((const uint8_t *)s, strlen(s)); }
 static void out_nl(void){ out_ch('\n'); }
 static void out_uint(unsigned long v){
-  char buf[32];
-  int n = 0;
+  uint8_t buf[32];
+  int n = sizeof(buf);
   do{
-    buf[n++] = (char)('0' + (v % 10u));
+    buf[--n] = (uint8_t)('0' + (v % 10u));
     v /= 10u;
   }while(v != 0u);
-  while(n--) out_ch(buf[n]);
+  vm_write(buf + n, sizeof(buf) - (size_t)n);
 }
 static void out_int(int v){
   if(v < 0){
@@ -140,123 +544,364 @@ static void out_err_u(const char *prefix, unsigned long v){
   out_nl();
 }
 
+/* an error inside : ... ; drops the unfinished definition and what it compiled */
+static void def_abandon(void){
+  while(vm->dict_n > vm->def_mark.dict_n){
+    Word *w = &vm->dict[--vm->dict_n];
+    vm->dict_hash[w->hash & (DICT_HASH-1)] = w->hnext;
+  }
+  vm->latest = vm->def_mark.latest;
+  vm->last_created = vm->def_mark.last_created;
+  vm->here_code = vm->def_mark.here_code;
+  vm->here_data = vm->def_mark.here_data;
+}
+
 static void runtime_recover(const char *msg){
   out_nl();
   out_err(msg);
-  dsp = 0;
-  rsp = 0;
-  running = 0;
-  compiling = 0;
-  current_def = -1;
-  data_mem[0] = 0;         /* A_STATE */
-  data_mem[2] = data_mem[3]; /* A_IN = A_NTIB */
-  if(recover_active){
-    recover_requested = 1;
-    longjmp(recover_env, 1);
+#if KFORTH_TASKS
+  if(vm->task_cur >= 0){ vm_flush(); longjmp(vm->task_env, 1); }   /* task_round stops that task */
+#endif
+  if(vm->current_def >= 0) def_abandon();
+  vm->dsp = 0;
+  vm->rsp = 0;
+  vm->running = 0;
+  vm->rs_base = 0;
+  vm->compiling = 0;
+  vm->current_def = -1;
+#if KFORTH_JIT
+  vm->jit_active = 0;          /* native frames were unwound */
+#endif
+  vm->data_mem[0] = 0;         /* A_STATE */
+  vm->data_mem[2] = vm->data_mem[3]; /* A_IN = A_NTIB */
+  vm_flush();
+  if(vm->recover_active){
+    vm->recover_requested = 1;
+    longjmp(vm->recover_env, 1);
   }
-  exit(1);
+  vm_exit(1);
 }
 
 /* ===== stacks ===== */
-static void dpush(cell v){ if(dsp>=DS_DEPTH){ runtime_recover("data stack overflow"); } DS[dsp++]=v; }
+static void dpush(cell v){ if(vm->dsp>=DS_DEPTH){ runtime_recover("data stack overflow"); } vm->DS[vm->dsp++]=v; }
 static cell dpop(void){
-  if(dsp<=0){ runtime_recover("data stack underflow"); }
-  return DS[--dsp];
+  if(vm->dsp<=0){ runtime_recover("data stack underflow"); }
+  return vm->DS[--vm->dsp];
 }
 static cell dpeek(void){
-  if(dsp<=0){ runtime_recover("data stack underflow"); }
-  return DS[dsp-1];
+  if(vm->dsp<=0){ runtime_recover("data stack underflow"); }
+  return vm->DS[vm->dsp-1];
 }
 
-static void rpush(cell v){ if(rsp>=RS_DEPTH){ runtime_recover("return stack overflow"); } RS[rsp++]=v; }
-static cell rpop(void){ if(rsp<=0){ runtime_recover("return stack underflow"); } return RS[--rsp]; }
+static void rpush(cell v){ if(vm->rsp>=RS_DEPTH){ runtime_recover("return stack overflow"); } vm->RS[vm->rsp++]=v; }
+static cell rpop(void){ if(vm->rsp<=0){ runtime_recover("return stack underflow"); } return vm->RS[--vm->rsp]; }
 
 /* ===== code/data memory ===== */
 static void ccomma(cell v){
-  if(here_code >= MEM_CODE_CELLS){ out_err("code full"); exit(1); }
-  code_mem[here_code++] = v;
+  if(vm->here_code >= vm->code_max){ runtime_recover("code full"); }
+#if KFORTH_JIT
+  jit_invalidate(vm->here_code);
+#endif
+  vm->code_mem[vm->here_code++] = v;
 }
 static void dcomma(cell v){
-  if(here_data >= MEM_DATA_CELLS){ out_err("data full"); exit(1); }
-  data_mem[here_data++] = v;
+  if(vm->here_data >= vm->data_max){ runtime_recover("data full"); }
+  vm->data_mem[vm->here_data++] = v;
 }
 
 /* byte mapping onto data_mem (byte-addressed for C@ C! TIB etc.) */
-static uint8_t fetch_byte(ucell byte_addr){
-  ucell celli = byte_addr / (ucell)CELL_BYTES;
-  ucell bsel  = byte_addr % (ucell)CELL_BYTES;
-  ucell w = (ucell)data_mem[celli];
-  return (uint8_t)((w >> (8u * bsel)) & 0xFFu);
-}
-static void store_byte(ucell byte_addr, uint8_t v){
-  ucell celli = byte_addr / (ucell)CELL_BYTES;
-  ucell bsel  = byte_addr % (ucell)CELL_BYTES;
-  ucell sh = 8u * bsel;
-  ucell mask = (ucell)0xFFu << sh;
-  ucell w = (ucell)data_mem[celli];
-  w = (w & ~mask) | (((ucell)v) << sh);
-  data_mem[celli] = (cell)w;
+/*
+  Data space is also a byte array: byte address 4*i+k is byte k of cell i
+  in host order. Byte, 16-bit and unaligned cell accessors load and store
+  it natively after one bounds check.
+*/
+enum { MEM_DATA_BYTES = MEM_DATA_CELLS * CELL_BYTES };
+#define DATA_BYTES ((uint8_t *)vm->data_mem)
+
+static uint8_t fetch_byte(ucell byte_addr){ return DATA_BYTES[byte_addr]; }
+static void store_byte(ucell byte_addr, uint8_t v){ DATA_BYTES[byte_addr] = v; }
+
+#if KFORTH_FILES
+/*
+  A file mapped by MAP-FILE is read, not copied, at byte addresses MAP_BASE
+  and up. Fetches and bulk reads that miss data space look there before
+  reporting a bad address; stores never do.
+*/
+enum { MAP_BASE = 0x40000000, MAP_MAX = 0x40000000 };
+static const uint8_t *map_bytes(ucell a, ucell n){
+  if(a < (ucell)MAP_BASE) return NULL;
+  size_t off = (size_t)(a - (ucell)MAP_BASE);
+  if(off > vm->map_len || (size_t)n > vm->map_len - off) return NULL;
+  return vm->map_mem + off;
 }
+#endif
 
 /* ===== dictionary ===== */
+/* FNV-1a; names are looked up through dict_hash, newest definition first */
+#define NAME_HASH_SEED 2166136261u
+static uint32_t name_hash_step(uint32_t h, uint8_t b){ return (h ^ b) * 16777619u; }
+static uint32_t name_hash(const char *s, int n){
+  uint32_t h = NAME_HASH_SEED;
+  for(int i=0;i<n;i++) h = name_hash_step(h, (uint8_t)s[i]);
+  return h;
+}
+
+static void dict_hash_init(void){
+  for(int i=0;i<DICT_HASH;i++) vm->dict_hash[i] = -1;
+}
+
 static int add_word(const char *name, ucell cfa_xt, uint8_t imm){
-  if(dict_n >= DICT_MAX){ out_err("dict full"); exit(1); }
-  Word *w = &dict[dict_n];
-  w->link = latest;
+  if(vm->dict_n >= vm->dict_max){ runtime_recover("dict full"); }
+  Word *w = &vm->dict[vm->dict_n];
+  w->link = vm->latest;
   strncpy(w->name, name, NAME_MAX);
   w->name[NAME_MAX]=0;
+  w->len = (uint8_t)strlen(w->name);
+  w->hash = name_hash(w->name, w->len);
   w->immediate = imm;
+  w->noinline = 0;
   w->cfa = cfa_xt;
   w->pfa = 0;
   w->does_ip = 0;
-  latest = dict_n;
-  return dict_n++;
+  int *bucket = &vm->dict_hash[w->hash & (DICT_HASH-1)];
+  w->hnext = *bucket;
+  *bucket = vm->dict_n;
+  vm->latest = vm->dict_n;
+  return vm->dict_n++;
 }
 
-static int find_word_cstr(const char *name){
-  for(int i=latest; i!=-1; i=dict[i].link){
-    if(strcmp(dict[i].name, name)==0) return i;
+#if !KFORTH_APP
+static int find_word_n(const char *name, size_t n){
+  if(n > NAME_MAX) return -1;
+  uint32_t h = name_hash(name, (int)n);
+  for(int i=vm->dict_hash[h & (DICT_HASH-1)]; i!=-1; i=vm->dict[i].hnext){
+    if(vm->dict[i].hash == h && vm->dict[i].len == n && memcmp(vm->dict[i].name, name, n)==0) return i;
   }
   return -1;
 }
 
+static int find_word_cstr(const char *name){
+  return find_word_n(name, strlen(name));
+}
+#endif
+
+#if KFORTH_PROFILE
+static int prim_wi[PRIM_MAX];   /* xt -> the primitive's dictionary entry */
+#endif
+
 static ucell def_prim(const char *name, prim_fn fn, uint8_t imm){
-  if(prim_n >= PRIM_MAX){ out_err("prim full"); exit(1); }
+  if(prim_n >= PRIM_MAX){ out_err("prim full"); vm_exit(1); }
   ucell xt = (ucell)prim_n;
   prim_table[prim_n++] = fn;
+#if KFORTH_PROFILE
+  prim_wi[xt] = add_word(name, xt, imm);
+#else
   (void)add_word(name, xt, imm);
+#endif
   return xt;
 }
+#if KFORTH_APP
+/*
+  A SAVE-C program keeps the primitive numbering but no names, and none of
+  the text interpreter: words that parse input or look names up (def_text)
+  are registered as p_NOTEXT.
+*/
+static void p_NOTEXT(void){ runtime_recover("no text interpreter in a SAVE-C program"); }
+#define def_prim(name, fn, imm) def_prim("", fn, imm)
+#define def_text(name, fn, imm) def_prim("", p_NOTEXT, imm)
+#elif KFORTH_SAVE_C
+/* C function behind each primitive, so SAVE-C output can call it directly */
+static const char *prim_cname[PRIM_MAX + 1];
+static uint8_t prim_text[PRIM_MAX + 1];   /* p_NOTEXT in the program: called through prim_table */
+#define def_prim(name, fn, imm) (prim_cname[prim_n] = #fn, def_prim(name, fn, imm))
+#define def_text(name, fn, imm) (prim_text[prim_n] = 1, def_prim(name, fn, imm))
+#else
+#define def_text def_prim
+#endif
 
-/* ===== execution ===== */
-static void exec_cell(cell instr);
+#if KFORTH_PROFILE
+/* ===== profiler: executed cells per call path ===== */
+/*
+  Every executed cell is charged to the word it invokes, under the node of
+  the colon word whose body is running. A frame is pushed when a colon or
+  DOES> body is entered and dropped once the return stack falls below the
+  return address it pushed, so EXIT, ABORT and RS tricks all unwind it.
+*/
+static void prof_reset(void){
+  memset(vm->prof_hash, 0, sizeof(vm->prof_hash));
+  vm->prof_node[0] = (ProfNode){ -1, -1, 0, 0 };
+  vm->prof_n = 1;
+  vm->prof_sp = 0;
+}
 
-static void exec_word(int wi){
-  if(wi < 0 || wi >= dict_n){ out_err_i("bad wi ", wi); exit(1); }
-  current_wi = wi;
-  ucell xt = dict[wi].cfa;
-  if(xt >= (ucell)prim_n){ out_err_u("bad xt ", (unsigned)xt); exit(1); }
-  prim_table[xt]();
+static int prof_child(int parent, int wi){
+  uint32_t h = ((uint32_t)parent * 2654435761u ^ (uint32_t)wi) & (PROF_HASH - 1);
+  for(int n; (n = vm->prof_hash[h]) != 0; h = (h + 1) & (PROF_HASH - 1)){
+    if(vm->prof_node[n-1].parent == parent && vm->prof_node[n-1].wi == wi) return n - 1;
+  }
+  if(vm->prof_n >= PROF_NODES) return parent;   /* full: charge the caller */
+  int n = vm->prof_n++;
+  vm->prof_node[n] = (ProfNode){ parent, wi, 0, 0 };
+  vm->prof_hash[h] = n + 1;
+  return n;
 }
 
-static void run_thread(void){
-  running = 1;
-  while(running){
-    cell instr = code_mem[ip++];
-    exec_cell(instr);
+static int prof_top(void){
+  while(vm->prof_sp > 0 && vm->prof_frame[vm->prof_sp-1].rdepth > vm->rsp) vm->prof_sp--;
+  return vm->prof_sp ? vm->prof_frame[vm->prof_sp-1].node : 0;
+}
+
+static int is_body_word(int wi){
+  return vm->dict[wi].cfa == XT_DOCOL || vm->dict[wi].cfa == XT_DODOES;
+}
+
+/* one executed cell invoking wi (-1: not a word) */
+static void prof_cell(int wi){
+  if(wi < 0) return;
+  ProfNode *n = &vm->prof_node[prof_child(prof_top(), wi)];
+  n->self++;
+  if(!is_body_word(wi)) n->calls++;
+}
+
+/* colon/DOES> body of wi entered, return address already pushed */
+static void prof_enter(int wi){
+  int n = prof_child(prof_top(), wi);
+  vm->prof_node[n].calls++;
+  if(vm->prof_sp <= RS_DEPTH){
+    vm->prof_frame[vm->prof_sp].node = n;
+    vm->prof_frame[vm->prof_sp].rdepth = vm->rsp;
+    vm->prof_sp++;
+  }
+}
+
+/* tail call: wi's body replaces the current frame */
+static void prof_tail(int wi){
+  (void)prof_top();
+  if(vm->prof_sp > 0 && vm->prof_frame[vm->prof_sp-1].rdepth == vm->rsp) vm->prof_sp--;
+  prof_enter(wi);
+}
+
+/* inclusive cells per node: children always come after their parent */
+static uint64_t *prof_totals(void){
+  uint64_t *t = (uint64_t *)malloc((size_t)vm->prof_n * sizeof(uint64_t));
+  if(!t) return NULL;
+  for(int i=0;i<vm->prof_n;i++) t[i] = vm->prof_node[i].self;
+  for(int i=vm->prof_n-1;i>0;i--) t[vm->prof_node[i].parent] += t[i];
+  return t;
+}
+
+static void out_col(unsigned long v, int width){
+  unsigned long d = v;
+  int n = 1;
+  while(d >= 10u){ d /= 10u; n++; }
+  while(n++ < width) out_ch(' ');
+  out_uint(v);
+}
+
+/* PROFILE-REPORT: calls, exclusive and inclusive cells per word, by inclusive.
+   A colon word's exclusive count covers its body minus nested colon words. */
+static void p_PROFILEREPORT(void){
+  uint64_t *tot = prof_totals();
+  uint64_t *w = (uint64_t *)calloc((size_t)vm->dict_n * 3, sizeof(uint64_t));
+  int *order = (int *)malloc((size_t)vm->dict_n * sizeof(int));
+  if(!tot || !w || !order){ free(tot); free(w); free(order); runtime_recover("PROFILE-REPORT no memory"); }
+  for(int i=1;i<vm->prof_n;i++){
+    const ProfNode *n = &vm->prof_node[i];
+    w[n->wi*3+0] += n->calls;
+    w[n->wi*3+1] += n->self;
+    if(n->parent > 0 && !is_body_word(n->wi)) w[vm->prof_node[n->parent].wi*3+1] += n->self;
+    int p = n->parent;
+    while(p > 0 && vm->prof_node[p].wi != n->wi) p = vm->prof_node[p].parent;
+    if(p <= 0) w[n->wi*3+2] += tot[i];   /* outermost activation only */
+  }
+  int k = 0;
+  for(int i=0;i<vm->dict_n;i++){
+    if(w[i*3+0] == 0 && w[i*3+1] == 0) continue;
+    int j = k++;
+    while(j > 0 && w[order[j-1]*3+2] < w[i*3+2]){ order[j] = order[j-1]; j--; }
+    order[j] = i;
+  }
+  out_nl();
+  out_str("     calls       self       incl  name");
+  out_nl();
+  for(int j=0;j<k;j++){
+    int i = order[j];
+    out_col((unsigned long)w[i*3+0], 10); out_ch(' ');
+    out_col((unsigned long)w[i*3+1], 10); out_ch(' ');
+    out_col((unsigned long)w[i*3+2], 10); out_str("  ");
+    out_str(vm->dict[i].name);
+    out_nl();
   }
+  free(tot);
+  free(w);
+  free(order);
+}
+
+#if !KFORTH_APP   /* run by --profile-out */
+/* folded stacks ("A;B;C cells" per line, ; in names as |) for flamegraph tools; 0 on error */
+static int prof_dump(const char *path){
+  FILE *f = fopen(path, "w");
+  if(!f) return 0;
+  int chain[RS_DEPTH + 2];
+  for(int i=1;i<vm->prof_n;i++){
+    if(vm->prof_node[i].self == 0) continue;
+    int d = 0;
+    for(int n=i; n>0 && d<(int)(sizeof(chain)/sizeof(chain[0])); n=vm->prof_node[n].parent) chain[d++] = n;
+    while(d--){
+      for(const char *c = vm->dict[vm->prof_node[chain[d]].wi].name; *c; c++) fputc(*c == ';' ? '|' : *c, f);
+      fputc(d ? ';' : ' ', f);
+    }
+    fprintf(f, "%llu\n", (unsigned long long)vm->prof_node[i].self);
+  }
+  return fclose(f) == 0;
+}
+#endif
+
+static void p_PROFILEON(void){ vm->prof_on = 1; }
+static void p_PROFILEOFF(void){ vm->prof_on = 0; }
+static void p_PROFILERESET(void){ prof_reset(); }
+#endif
+
+/* ===== execution ===== */
+static void run_thread(void);
+
+static void exec_word(int wi){
+  if(wi < 0 || wi >= vm->dict_n){ out_err_i("bad wi ", wi); vm_exit(1); }
+  vm->current_wi = wi;
+  ucell xt = vm->dict[wi].cfa;
+  if(xt >= (ucell)prim_n){ out_err_u("bad xt ", (unsigned)xt); vm_exit(1); }
+  prim_table[xt]();
 }
 
+#if !KFORTH_DIRECT_THREADED
 static void exec_cell(cell instr){
   if(IS_WORDTOK(instr)){
     exec_word(WORD_ID(instr));
   }else{
     ucell xt = (ucell)instr;
-    if(xt >= (ucell)prim_n){ out_err_u("bad xt ", (unsigned)xt); exit(1); }
+    if(xt >= (ucell)prim_n){ out_err_u("bad xt ", (unsigned)xt); vm_exit(1); }
     prim_table[xt]();
   }
 }
 
+static void run_thread(void){
+  vm->running = 1;
+  while(vm->running){
+    cell instr = vm->code_mem[vm->ip++];
+#if KFORTH_COUNT_CELLS
+    vm->cells_run++;
+#endif
+#if KFORTH_PROFILE
+    if(vm->prof_on){
+      ucell x = (ucell)instr;
+      prof_cell(IS_WORDTOK(instr) ? WORD_ID(instr) : x < (ucell)prim_n ? prim_wi[x] : -1);
+    }
+#endif
+    exec_cell(instr);
+  }
+}
+#endif
+
 /* ===== reserved data layout for self-host REPL ===== */
 enum { TIB_BYTES = 256, TIB_CELLS = (TIB_BYTES / CELL_BYTES) };
 static const ucell A_STATE = 0;   /* cell: 0 interpret, 1 compile */
@@ -264,140 +909,360 @@ static const ucell A_BASE  = 1;   /* cell: radix */
 static const ucell A_IN    = 2;   /* cell: >IN (byte index into TIB) */
 static const ucell A_NTIB  = 3;   /* cell: #TIB (byte length) */
 static const ucell A_TIB   = 4;   /* cells: TIB */
+enum { TRANS_CELLS = (KFORTH_TRANSIENT_BYTES + CELL_BYTES - 1) / CELL_BYTES, TRANS_BYTES = TRANS_CELLS * CELL_BYTES };
+#if KFORTH_TASKS
+static const ucell A_USER  = 4 + TIB_CELLS;   /* cells: the operator's USER variables */
+static const ucell A_TRANS = 4 + TIB_CELLS + TASK_USER;   /* cells: transient string ring */
+#else
+static const ucell A_TRANS = 4 + TIB_CELLS;
+#endif
 
 static void init_data_layout(void){
-  data_mem[A_STATE] = 0;
-  data_mem[A_BASE]  = 10;
-  data_mem[A_IN]    = 0;
-  data_mem[A_NTIB]  = 0;
-  for(ucell i=0;i<TIB_CELLS;i++) data_mem[A_TIB+i]=0;
-  here_data = (ucell)(A_TIB + TIB_CELLS);
+  vm->data_mem[A_STATE] = 0;
+  vm->data_mem[A_BASE]  = 10;
+  vm->data_mem[A_IN]    = 0;
+  vm->data_mem[A_NTIB]  = 0;
+  for(ucell i=0;i<TIB_CELLS;i++) vm->data_mem[A_TIB+i]=0;
+#if KFORTH_TASKS
+  for(ucell i=0;i<TASK_USER;i++) vm->data_mem[A_USER+i]=0;
+#endif
+  for(ucell i=0;i<TRANS_CELLS;i++) vm->data_mem[A_TRANS+i]=0;
+  vm->here_data = (ucell)(A_TRANS + TRANS_CELLS);
 }
 
+#if !KFORTH_APP
 /* ===== stdin-only token reader for C outer interpreter ===== */
-static int prompt_mode = 0;
-static int token_end_delim = '\n';
+/* scans the input window in place; only a token split by a refill is copied */
 
-static void discard_to_eol(void){
-  int c;
-  while((c = mf_key()) >= 0){
-    if(c == '\n') break;
+static const uint8_t in_blank[256] = {
+  [' '] = 1, ['\t'] = 1, ['\n'] = 1, ['\v'] = 1, ['\f'] = 1, ['\r'] = 1
+};
+
+/* consume input through the next ch; 0 if EOF came first */
+static int in_skip_past(uint8_t ch){
+  size_t len;
+  const uint8_t *p;
+  while(p = vm_in_window(&len), len != 0){
+    const uint8_t *q = memchr(p, ch, len);
+    if(q){ vm_in_consume((size_t)(q - p) + 1); return 1; }
+    vm_in_consume(len);
   }
+  return 0;
 }
 
-static int in_getch(void){
-  return mf_key();
+static void discard_to_eol(void){
+  (void)in_skip_past('\n');
 }
 
 static int read_quoted(char *buf, size_t bufsz, int *out_len){
-  int c;
-  int n = 0;
+  size_t n = 0;
   while(1){
-    c = in_getch();
-    if(c < 0){
+    size_t len;
+    const uint8_t *p = vm_in_window(&len);
+    if(len == 0){
       out_err("unterminated string");
       p_ABORT();
       return 0;
     }
-    if(c == '"') break;
-    if((size_t)n + 1 >= bufsz){
+    const uint8_t *q = memchr(p, '"', len);
+    size_t k = q ? (size_t)(q - p) : len;
+    if(n + k >= bufsz){
+      vm_in_consume(k);
       out_err("string too long");
       p_ABORT();
       return 0;
     }
-    buf[n++] = (char)c;
+    memcpy(buf + n, p, k);
+    n += k;
+    vm_in_consume(q ? k + 1 : k);
+    if(q) break;
   }
-  *out_len = n;
+  *out_len = (int)n;
   return 1;
 }
+#endif
 
 static cell alloc_string_data(const char *buf, int len){
-  if(len < 0){ out_err("bad string length"); exit(1); }
+  if(len < 0){ out_err("bad string length"); vm_exit(1); }
   ucell cells = (ucell)((len + CELL_BYTES - 1) / CELL_BYTES);
-  if((uint64_t)len > ((uint64_t)MEM_DATA_CELLS * (uint64_t)CELL_BYTES)){ out_err("string too big"); exit(1); }
-  if(here_data + cells > MEM_DATA_CELLS){ out_err("data full"); exit(1); }
-  ucell addr = (ucell)(here_data * (ucell)CELL_BYTES);
+  if((uint64_t)len > ((uint64_t)MEM_DATA_CELLS * (uint64_t)CELL_BYTES)){ out_err("string too big"); vm_exit(1); }
+  if(vm->here_data + cells > vm->data_max){ runtime_recover("data full"); }
+  ucell addr = (ucell)(vm->here_data * (ucell)CELL_BYTES);
   for(int i=0;i<len;i++){
     store_byte((ucell)(addr + (ucell)i), (uint8_t)buf[i]);
   }
   for(int i=len; (i % CELL_BYTES) != 0; i++){
     store_byte((ucell)(addr + (ucell)i), 0);
   }
-  here_data = (ucell)(here_data + cells);
+  vm->here_data = (ucell)(vm->here_data + cells);
+  return (cell)addr;
+}
+
+/*
+  A string that only has to outlive the current line goes in the transient
+  ring, cell aligned, and stays valid until the ring wraps around onto it.
+  Anything longer than half the ring falls back to data space, so the last
+  two transient strings never overlap.
+*/
+static cell alloc_transient(const char *buf, int len){
+  if(len < 0 || len > TRANS_BYTES / 2) return alloc_string_data(buf, len);
+  ucell at = vm->trans_at;
+  if(at + (ucell)len > (ucell)TRANS_BYTES) at = 0;
+  ucell addr = A_TRANS * (ucell)CELL_BYTES + at;
+  memcpy(DATA_BYTES + addr, buf, (size_t)len);
+  vm->trans_at = (at + (ucell)len + CELL_BYTES - 1) / CELL_BYTES * CELL_BYTES;
   return (cell)addr;
 }
 
+#if !KFORTH_APP
 static void compile_lit_cell(cell v){
-  if(WI_LIT < 0){ out_err("no LIT"); exit(1); }
+  if(WI_LIT < 0){ out_err("no LIT"); vm_exit(1); }
   compile_wordtok(WI_LIT);
   ccomma(v);
 }
+#endif
+
+#if !KFORTH_APP
+/*
+  next whitespace-delimited token from stdin, left in the input window
+  (valid until more input is read); returns 1/0
+*/
+static int next_token_ref(const char **out, size_t *outn){
+  size_t len, i;
+  const uint8_t *p;
+  while(1){
+    p = vm_in_window(&len);
+    if(len == 0) return 0;
+    for(i = 0; i < len && in_blank[p[i]]; i++) ;
+    vm_in_consume(i);
+    if(i < len) break;
+  }
+  p += i;
+  len -= i;
+  for(i = 0; i < len && !in_blank[p[i]]; i++) ;
+  if(i < len){
+    vm->token_end_delim = p[i];
+    vm_in_consume(i + 1);
+    *out = (const char *)p;
+    *outn = i;
+    return 1;
+  }
+
+  size_t n = 0;
+  while(1){
+    for(size_t k = 0; k < i && n + 1 < sizeof(vm->tok_join); k++) vm->tok_join[n++] = (char)p[k];
+    if(i < len){
+      vm->token_end_delim = p[i];
+      vm_in_consume(i + 1);
+      break;
+    }
+    vm_in_consume(i);
+    p = vm_in_window(&len);
+    if(len == 0){ vm->token_end_delim = -1; break; }
+    for(i = 0; i < len && !in_blank[p[i]]; i++) ;
+  }
+  *out = vm->tok_join;
+  *outn = n;
+  return 1;
+}
 
-/* reads next whitespace-delimited token from stdin; returns 1/0 */
+/* reads next whitespace-delimited token from stdin into out; returns 1/0 */
 static int next_token(char *out, size_t outsz){
-  int c;
-  do{
-    c = in_getch();
-    if(c < 0) return 0;
-  }while(isspace((unsigned char)c));
+  const char *t;
+  size_t n;
+  if(!next_token_ref(&t, &n)) return 0;
+  if(n >= outsz) n = outsz - 1;
+  memcpy(out, t, n);
+  out[n] = 0;
+  return 1;
+}
+#endif
+
+#if KFORTH_TASKS
+/* ===== cooperative tasks ===== */
+/*
+  A TASK is a block in data space: its ip, the stacks it had when it last
+  paused, and its USER variables. The operator (the interpreter reading the
+  terminal) runs every ready task once, in order, at PAUSE, during MS and
+  while it waits for input. Tasks run on the VM's own stacks; the
+  operator's are parked in task_ds/task_rs meanwhile. A task gives the CPU
+  back at PAUSE, STOP, MS, a KEY with no input, an IO@ with no data or an
+  IO-WAIT that would block.
+*/
+enum { TK_TAG, TK_STATUS, TK_IP, TK_DSP, TK_RSP, TK_WAKE, TK_RETRY, TK_USER,
+       TK_DS = TK_USER + TASK_USER, TK_RS = TK_DS + TASK_STACK, TK_CELLS = TK_RS + TASK_STACK };
+enum { TASK_TAG = 0x4B534154 /* "TASK" */ };
+enum { TS_STOPPED, TS_READY, TS_ASLEEP };
+
+static int task_runnable(cell *b){
+  if(b[TK_STATUS] == TS_ASLEEP && (int32_t)(kf_ms() - (uint32_t)b[TK_WAKE]) >= 0) b[TK_STATUS] = TS_READY;
+  return b[TK_STATUS] == TS_READY;
+}
+
+static int task_live(void){
+  for(int i=0;i<vm->task_n;i++){
+    if(vm->data_mem[vm->task_blk[i] + TK_STATUS] != TS_STOPPED) return 1;
+  }
+  return 0;
+}
+
+/* one turn of the running task; 0 if an error ended it */
+static int task_run(void){
+  if(setjmp(vm->task_env) != 0) return 0;
+  run_thread();
+  return 1;
+}
+
+/* the operator runs each ready task until it gives up the CPU; returns how many ran */
+static int task_round(void){
+  if(vm->task_cur >= 0 || vm->task_n == 0) return 0;
+  int dsp = vm->dsp, rsp = vm->rsp, rs_base = vm->rs_base, running = vm->running, wi = vm->current_wi;
+#if KFORTH_JIT
+  int jit_active = vm->jit_active;
+#endif
+  ucell ip = vm->ip;
+  cell state = vm->data_mem[A_STATE];
+  int ran = 0;
+  memcpy(vm->task_ds, vm->DS, (size_t)dsp * sizeof(cell));
+  memcpy(vm->task_rs, vm->RS, (size_t)rsp * sizeof(cell));
+  vm->data_mem[A_STATE] = 0;   /* branch words compile themselves while STATE is set */
+  for(int i=0;i<vm->task_n;i++){
+    ucell t = vm->task_blk[i];
+    cell *b = &vm->data_mem[t];
+    if(!task_runnable(b)) continue;
+    vm->task_cur = i;
+    vm->task_up = t + TK_USER;
+    vm->dsp = (int)b[TK_DSP];
+    vm->rsp = (int)b[TK_RSP];
+    memcpy(vm->DS, b + TK_DS, (size_t)vm->dsp * sizeof(cell));
+    memcpy(vm->RS, b + TK_RS, (size_t)vm->rsp * sizeof(cell));
+    vm->ip = (ucell)b[TK_IP];
+    vm->rs_base = 0;
+    vm->task_yield = 0;
+    int ok = task_run();
+    ran++;
+    if(!ok || !vm->task_yield){
+      b[TK_STATUS] = TS_STOPPED;   /* its definition ended, or an error did */
+#if KFORTH_JIT
+      vm->jit_active = jit_active;
+#endif
+    }else if(vm->dsp > TASK_STACK || vm->rsp > TASK_STACK){
+      out_err("task stack overflow");
+      b[TK_STATUS] = TS_STOPPED;
+    }else{
+      b[TK_IP] = (cell)vm->ip;
+      b[TK_DSP] = vm->dsp;
+      b[TK_RSP] = vm->rsp;
+      memcpy(b + TK_DS, vm->DS, (size_t)vm->dsp * sizeof(cell));
+      memcpy(b + TK_RS, vm->RS, (size_t)vm->rsp * sizeof(cell));
+    }
+  }
+  vm->task_cur = -1;
+  vm->task_up = A_USER;
+  vm->data_mem[A_STATE] = state;
+  vm->dsp = dsp;
+  vm->rsp = rsp;
+  memcpy(vm->DS, vm->task_ds, (size_t)dsp * sizeof(cell));
+  memcpy(vm->RS, vm->task_rs, (size_t)rsp * sizeof(cell));
+  vm->ip = ip;
+  vm->rs_base = rs_base;
+  vm->running = running;
+  vm->current_wi = wi;
+  return ran;
+}
 
-  size_t n=0;
-  while(c >= 0 && !isspace((unsigned char)c)){
-    if(n+1 < outsz) out[n++] = (char)c;
-    c = in_getch();
+/* the running task gives up the CPU after this primitive; 0 if it cannot here */
+static int task_leave(cell status){
+  if(vm->task_cur < 0 || vm->rs_base != 0) return 0;   /* operator, or a nested interpreter */
+  vm->data_mem[vm->task_blk[vm->task_cur] + TK_STATUS] = status;
+  vm->task_yield = 1;
+  vm->running = 0;
+  return 1;
+}
+
+/* the operator is about to wait for the terminal: run the tasks until input arrives */
+static void task_wait_input(void){
+  if(vm->task_cur >= 0) return;
+  while(!mf_key_ready() && task_live()){
+    if(!task_round()) kf_idle();
+    vm_flush();
   }
-  token_end_delim = c;
-  out[n]=0;
+}
+
+/* a task would block in primitive xt: leave, and run that cell again on its next turn */
+static int task_retry(ucell xt){
+  if(vm->task_cur < 0 || vm->ip == 0) return 0;
+  cell c = vm->code_mem[vm->ip - 1];
+  ucell x = (ucell)c;
+  if(IS_WORDTOK(c)) x = WORD_ID(c) < vm->dict_n ? vm->dict[WORD_ID(c)].cfa : (ucell)-1;
+  if(x != xt || !task_leave(TS_READY)) return 0;
+  vm->ip--;
   return 1;
 }
 
+#endif
+
 /* ===== primitives ===== */
 
 /* core */
 static void p_EXIT(void){
-  ip = (ucell)rpop();
-  if(rsp == 0) running = 0;
+  vm->ip = (ucell)rpop();
+  if(vm->rsp == vm->rs_base) vm->running = 0;
 }
-static void p_LIT(void){ dpush(code_mem[ip++]); }
+static void p_LIT(void){ dpush(vm->code_mem[vm->ip++]); }
 static void p_BRANCH(void){
-  if(data_mem[A_STATE] != 0){
+  if(vm->data_mem[A_STATE] != 0){
     ccomma((cell)XT_BRANCH);
     return;
   }
-  cell off = code_mem[ip++];
-  ip = (ucell)((cell)ip + off);
+  cell off = vm->code_mem[vm->ip++];
+  vm->ip = (ucell)((cell)vm->ip + off);
 }
 static void p_0BRANCH(void){
-  if(data_mem[A_STATE] != 0){
+  if(vm->data_mem[A_STATE] != 0){
     ccomma((cell)XT_0BRANCH);
     return;
   }
-  cell off = code_mem[ip++];
+  cell off = vm->code_mem[vm->ip++];
   cell f = dpop();
-  if(f == 0) ip = (ucell)((cell)ip + off);
+  if(f == 0) vm->ip = (ucell)((cell)vm->ip + off);
 }
 
 static void p_DOCOL(void){
-  Word *w = &dict[current_wi];
-  rpush((cell)ip);
-  ip = w->pfa;
+  Word *w = &vm->dict[vm->current_wi];
+  rpush((cell)vm->ip);
+  vm->ip = w->pfa;
+#if KFORTH_PROFILE
+  if(vm->prof_on) prof_enter(vm->current_wi);
+#endif
+#if KFORTH_APP
+  app_fn f = app_word(vm->current_wi);
+  if(f) f();
+#endif
 }
 static void p_DOVAR(void){
-  Word *w = &dict[current_wi];
+  Word *w = &vm->dict[vm->current_wi];
   dpush((cell)w->pfa);
 }
 static void p_DODOES(void){
-  Word *w = &dict[current_wi];
+  Word *w = &vm->dict[vm->current_wi];
   dpush((cell)w->pfa);
-  rpush((cell)ip);
-  ip = w->does_ip;
+  rpush((cell)vm->ip);
+  vm->ip = w->does_ip;
+#if KFORTH_PROFILE
+  if(vm->prof_on) prof_enter(vm->current_wi);
+#endif
+#if KFORTH_APP
+  app_fn f = app_word(vm->current_wi);
+  if(f) f();
+#endif
 }
 
 /* stack */
 static void p_DROP(void){ (void)dpop(); }
 static void p_DUP(void){ cell a=dpeek(); dpush(a); }
 static void p_SWAP(void){ cell b=dpop(), a=dpop(); dpush(b); dpush(a); }
-static void p_OVER(void){ if(dsp<2){ runtime_recover("data stack underflow"); } dpush(DS[dsp-2]); }
+static void p_OVER(void){ if(vm->dsp<2){ runtime_recover("data stack underflow"); } dpush(vm->DS[vm->dsp-2]); }
 
 /* arithmetic/logic */
 static void p_ADD(void){ cell b=dpop(), a=dpop(); dpush((cell)(a+b)); }
@@ -418,141 +1283,558 @@ static void p_0LT(void){
 }
 
 /* data fetch/store (cell-addressed) */
+/* @ past data space: a cell of the MAP-FILE window, else fatal */
+static cell fetch_far(cell a){
+#if KFORTH_FILES
+  const uint8_t *p = (ucell)a <= (ucell)0x7FFFFFFF / CELL_BYTES ? map_bytes((ucell)a * CELL_BYTES, CELL_BYTES) : NULL;
+  if(p){
+    cell v;
+    memcpy(&v, p, CELL_BYTES);
+    return v;
+  }
+#endif
+  out_err_i("@ bad ", a);
+  vm_exit(1);
+}
 static void p_FETCH(void){
   cell a = dpop();
-  if(a < 0 || (ucell)a >= (ucell)MEM_DATA_CELLS){ out_err_i("@ bad ", a); exit(1); }
-  dpush(data_mem[(ucell)a]);
+  dpush((ucell)a < (ucell)MEM_DATA_CELLS ? vm->data_mem[(ucell)a] : fetch_far(a));
 }
 static void p_STORE(void){
   cell a = dpop();
   cell v = dpop();
-  if(a < 0 || (ucell)a >= (ucell)MEM_DATA_CELLS){ out_err_i("! bad ", a); exit(1); }
-  data_mem[(ucell)a] = v;
+  if(a < 0 || (ucell)a >= (ucell)MEM_DATA_CELLS){ out_err_i("! bad ", a); vm_exit(1); }
+  vm->data_mem[(ucell)a] = v;
 }
 
-/* byte fetch/store (byte-addressed) */
+/* byte-addressed fetch/store: C 8-bit, W 16-bit, L a whole cell at any alignment */
+static ucell byte_at(cell a, ucell n, const char *who){
+  if((ucell)a > (ucell)MEM_DATA_BYTES - n){ out_err_i(who, a); vm_exit(1); }
+  return (ucell)a;
+}
+/* n bytes to fetch at a: data space, else the MAP-FILE window */
+static const uint8_t *fetch_at(cell a, ucell n, const char *who){
+  if((ucell)a <= (ucell)MEM_DATA_BYTES - n) return DATA_BYTES + (ucell)a;
+#if KFORTH_FILES
+  const uint8_t *p = map_bytes((ucell)a, n);
+  if(p) return p;
+#endif
+  out_err_i(who, a);
+  vm_exit(1);
+}
 static void p_CAT(void){
-  cell a = dpop();
-  if(a < 0 || (((ucell)a) / (ucell)CELL_BYTES) >= (ucell)MEM_DATA_CELLS){
-    out_err_i("C@ bad ", a);
-    exit(1);
-  }
-  dpush((cell)fetch_byte((ucell)a));
+  dpush((cell)*fetch_at(dpop(), 1, "C@ bad "));
 }
 static void p_CSTORE(void){
   cell a = dpop();
   cell v = dpop();
-  if(a < 0 || (((ucell)a) / (ucell)CELL_BYTES) >= (ucell)MEM_DATA_CELLS){
-    out_err_i("C! bad ", a);
-    exit(1);
-  }
-  store_byte((ucell)a, (uint8_t)(v & 0xFF));
+  store_byte(byte_at(a, 1, "C! bad "), (uint8_t)(v & 0xFF));
+}
+static void p_WFETCH(void){
+  uint16_t w;
+  memcpy(&w, fetch_at(dpop(), 2, "W@ bad "), 2);
+  dpush((cell)w);
+}
+static void p_WSTORE(void){
+  cell a = dpop();
+  uint16_t w = (uint16_t)dpop();
+  memcpy(DATA_BYTES + byte_at(a, 2, "W! bad "), &w, 2);
 }
+static void p_LFETCH(void){
+  cell v;
+  memcpy(&v, fetch_at(dpop(), CELL_BYTES, "L@ bad "), CELL_BYTES);
+  dpush(v);
+}
+static void p_LSTORE(void){
+  cell a = dpop();
+  cell v = dpop();
+  memcpy(DATA_BYTES + byte_at(a, CELL_BYTES, "L! bad "), &v, CELL_BYTES);
+}
+/* cell address <-> byte address of its first byte */
+static void p_CELLTOBYTE(void){ dpush((cell)((ucell)dpop() * (ucell)CELL_BYTES)); }
+static void p_BYTETOCELL(void){ dpush((cell)((ucell)dpop() / (ucell)CELL_BYTES)); }
 
-/* loops */
-static void p_DO(void){
-  if(data_mem[A_STATE] != 0){
-    ccomma((cell)XT_DO);
-    dpush((cell)here_code); /* loop body start */
-    return;
+/* bulk memory (byte-addressed); one bounds check per call */
+static ucell data_span(cell addr, cell len, const char *who){
+  if(len == 0) return 0;
+  if(addr < 0 || len < 0 ||
+     (uint64_t)(ucell)addr + (uint64_t)(ucell)len > (uint64_t)MEM_DATA_BYTES){
+    out_err_i(who, addr);
+    vm_exit(1);
+  }
+  return (ucell)addr;
+}
+/* a span only read from: data space, else the MAP-FILE window */
+static const uint8_t *fetch_span(cell addr, cell len, const char *who){
+  if(len == 0) return DATA_BYTES;
+  if(len > 0 && (uint64_t)(ucell)addr + (uint64_t)(ucell)len <= (uint64_t)MEM_DATA_BYTES) return DATA_BYTES + (ucell)addr;
+#if KFORTH_FILES
+  const uint8_t *p = len > 0 ? map_bytes((ucell)addr, (ucell)len) : NULL;
+  if(p) return p;
+#endif
+  out_err_i(who, addr);
+  vm_exit(1);
+}
+static void bytes_move(ucell dst, ucell src, ucell n){ memmove(DATA_BYTES + dst, DATA_BYTES + src, n); }
+static void bytes_fill(ucell dst, ucell n, uint8_t c){ memset(DATA_BYTES + dst, c, n); }
+
+/* write len bytes of data space starting at byte address a */
+static void out_bytes(ucell a, ucell len){ vm_write(DATA_BYTES + a, len); }
+
+/* MOVE ( src dst u -- ) */
+static void p_MOVE(void){
+  cell u = dpop(), dst = dpop(), src = dpop();
+  ucell d = data_span(dst, u, "MOVE bad ");
+  const uint8_t *s = fetch_span(src, u, "MOVE bad ");
+  memmove(DATA_BYTES + d, s, (size_t)u);
+}
+/* CMOVE ( src dst u -- ) low to high: an overlapping dst above src repeats the pattern */
+static void p_CMOVE(void){
+  cell u = dpop(), dst = dpop(), src = dpop();
+  ucell d = data_span(dst, u, "CMOVE bad ");
+  ucell s = data_span(src, u, "CMOVE bad ");
+  if(d > s && d < s + (ucell)u){
+    for(ucell i=0;i<(ucell)u;i++) store_byte(d + i, fetch_byte(s + i));
+  }else{
+    bytes_move(d, s, (ucell)u);
+  }
+}
+/* CMOVE> ( src dst u -- ) high to low */
+static void p_CMOVEUP(void){
+  cell u = dpop(), dst = dpop(), src = dpop();
+  ucell d = data_span(dst, u, "CMOVE> bad ");
+  ucell s = data_span(src, u, "CMOVE> bad ");
+  if(d < s && s < d + (ucell)u){
+    for(ucell i=(ucell)u;i>0;i--) store_byte(d + i - 1, fetch_byte(s + i - 1));
+  }else{
+    bytes_move(d, s, (ucell)u);
+  }
+}
+/* FILL ( addr u c -- ) */
+static void p_FILL(void){
+  cell c = dpop(), u = dpop(), addr = dpop();
+  bytes_fill(data_span(addr, u, "FILL bad "), (ucell)u, (uint8_t)(c & 0xFF));
+}
+/* ERASE ( addr u -- ) */
+static void p_ERASE(void){
+  cell u = dpop(), addr = dpop();
+  bytes_fill(data_span(addr, u, "ERASE bad "), (ucell)u, 0);
+}
+/* COMPARE ( a1 u1 a2 u2 -- n ) n = -1/0/1 */
+static void p_COMPARE(void){
+  cell u2 = dpop(), a2 = dpop(), u1 = dpop(), a1 = dpop();
+  const uint8_t *b2 = fetch_span(a2, u2, "COMPARE bad ");
+  const uint8_t *b1 = fetch_span(a1, u1, "COMPARE bad ");
+  int d = memcmp(b1, b2, (size_t)(u1 < u2 ? u1 : u2));
+  if(d == 0) d = (u1 > u2) - (u1 < u2);
+  dpush(d < 0 ? (cell)-1 : (d > 0 ? 1 : 0));
+}
+/* SEARCH ( a1 u1 a2 u2 -- a3 u3 flag ) */
+static void p_SEARCH(void){
+  cell u2 = dpop(), a2 = dpop(), u1 = dpop(), a1 = dpop();
+  const uint8_t *b2 = fetch_span(a2, u2, "SEARCH bad ");
+  const uint8_t *b1 = fetch_span(a1, u1, "SEARCH bad ");
+  if(u2 <= u1){
+    for(ucell i=0; i <= (ucell)(u1 - u2); i++){
+      if(memcmp(b1 + i, b2, (size_t)u2) == 0){
+        dpush((cell)(a1 + (cell)i));
+        dpush((cell)(u1 - (cell)i));
+        dpush((cell)-1);
+        return;
+      }
+    }
+  }
+  dpush(a1);
+  dpush(u1);
+  dpush(0);
+}
+
+/* loops */
+/*
+  Compile-time LEAVE chain: each (?DO)/(LEAVE) operand holds the address of
+  the previous one until LOOP or +LOOP patches them all to the loop end.
+  DO keeps the enclosing loop's chain on the data stack under its target.
+*/
+static void loop_open(void){
+  dpush(vm->leave_link);
+  vm->leave_link = -1;
+}
+static void leave_ref(void){
+  ucell a = vm->here_code;
+  ccomma(vm->leave_link);
+  vm->leave_link = (cell)a;
+}
+static void loop_close(void){
+  for(cell a = vm->leave_link; a >= 0; ){
+    cell prev = vm->code_mem[a];
+    vm->code_mem[a] = (cell)vm->here_code - (a + 1);
+    a = prev;
+  }
+  vm->leave_link = dpop();
+}
+
+static void p_DO(void){
+  if(vm->data_mem[A_STATE] != 0){
+    ccomma((cell)XT_DO);
+    loop_open();
+    dpush((cell)vm->here_code); /* loop body start */
+    return;
   }
   cell index = dpop();
   cell limit = dpop();
   rpush(limit);
   rpush(index);
 }
+static void p_QDO(void){
+  if(vm->data_mem[A_STATE] == 0){ out_err("?DO only during compile"); return; }
+  ccomma((cell)XT_XQDO);
+  loop_open();
+  leave_ref();
+  dpush((cell)vm->here_code);
+}
+static void p_LEAVE(void){
+  if(vm->data_mem[A_STATE] == 0 || vm->leave_link < -1){ out_err("LEAVE outside DO"); return; }
+  ccomma((cell)XT_XLEAVE);
+  leave_ref();
+}
+/* (?DO) off : enter the loop unless index = limit */
+static void p_XQDO(void){
+  cell off = vm->code_mem[vm->ip++];
+  cell index = dpop();
+  cell limit = dpop();
+  if(index == limit){ vm->ip = (ucell)((cell)vm->ip + off); return; }
+  rpush(limit);
+  rpush(index);
+}
+/* (LEAVE) off : UNLOOP and branch past the loop */
+static void p_XLEAVE(void){
+  cell off = vm->code_mem[vm->ip++];
+  if(vm->rsp < 2){ out_err("LEAVE RS underflow"); vm_exit(1); }
+  vm->rsp -= 2;
+  vm->ip = (ucell)((cell)vm->ip + off);
+}
 static void p_LOOP(void){
-  if(data_mem[A_STATE] != 0){
+  if(vm->data_mem[A_STATE] != 0){
     cell target = dpop();
     ccomma((cell)XT_LOOP);
-    ccomma((cell)(target - (cell)(here_code + 1)));
+    ccomma((cell)(target - (cell)(vm->here_code + 1)));
+    loop_close();
     return;
   }
-  cell off = code_mem[ip++];
-  cell index = rpop();
-  cell limit = rpop();
-  index = (cell)(index + 1);
-  if(index != limit){
-    rpush(limit);
-    rpush(index);
-    ip = (ucell)((cell)ip + off);
+  cell off = vm->code_mem[vm->ip++];
+  if(vm->rsp < 2) runtime_recover("return stack underflow");
+  cell index = (cell)((ucell)vm->RS[vm->rsp-1] + 1u);
+  if(index != vm->RS[vm->rsp-2]){
+    vm->RS[vm->rsp-1] = index;
+    vm->ip = (ucell)((cell)vm->ip + off);
+  }else{
+    vm->rsp -= 2;
   }
 }
+/* +LOOP ends when the index crosses the limit-1 | limit boundary, either way */
+static int loop_crossed(cell index, cell limit, cell step){
+  ucell d = (ucell)index - (ucell)limit;
+  return (cell)((d ^ (d + (ucell)step)) & (d ^ (ucell)step)) < 0;
+}
 static void p_PLOOP(void){
-  if(data_mem[A_STATE] != 0){
+  if(vm->data_mem[A_STATE] != 0){
     cell target = dpop();
     ccomma((cell)XT_PLOOP);
-    ccomma((cell)(target - (cell)(here_code + 1)));
+    ccomma((cell)(target - (cell)(vm->here_code + 1)));
+    loop_close();
     return;
   }
-  cell off  = code_mem[ip++];
+  cell off  = vm->code_mem[vm->ip++];
   cell step = dpop();
-  cell index = rpop();
-  cell limit = rpop();
-  cell newi  = (cell)(index + step);
-
-  int cont = 0;
-  if(step > 0) cont = (newi < limit);
-  else if(step < 0) cont = (newi >= limit);
-  else cont = (index != limit);
-
-  if(cont){
-    rpush(limit);
-    rpush(newi);
-    ip = (ucell)((cell)ip + off);
+  if(vm->rsp < 2) runtime_recover("return stack underflow");
+  cell index = vm->RS[vm->rsp-1];
+  if(loop_crossed(index, vm->RS[vm->rsp-2], step)){
+    vm->rsp -= 2;
+  }else{
+    vm->RS[vm->rsp-1] = (cell)((ucell)index + (ucell)step);
+    vm->ip = (ucell)((cell)vm->ip + off);
   }
 }
 static void p_I(void){
-  if(rsp < 2){ out_err("I RS underflow"); exit(1); }
-  dpush(RS[rsp-1]);
+  if(vm->rsp < 2){ out_err("I RS underflow"); vm_exit(1); }
+  dpush(vm->RS[vm->rsp-1]);
+}
+/* I + and I + @, fused by the ; peephole */
+static void p_IADD(void){
+  if(vm->rsp < 2){ out_err("I RS underflow"); vm_exit(1); }
+  cell a = dpop();
+  dpush((cell)((ucell)a + (ucell)vm->RS[vm->rsp-1]));
+}
+static void p_IADDFETCH(void){
+  if(vm->rsp < 2){ out_err("I RS underflow"); vm_exit(1); }
+  cell a = (cell)((ucell)dpop() + (ucell)vm->RS[vm->rsp-1]);
+  dpush((ucell)a < (ucell)MEM_DATA_CELLS ? vm->data_mem[(ucell)a] : fetch_far(a));
 }
 static void p_J(void){
-  if(rsp < 4){ out_err("J needs nested DO"); exit(1); }
-  dpush(RS[rsp-3]);
+  if(vm->rsp < 4){ out_err("J needs nested DO"); vm_exit(1); }
+  dpush(vm->RS[vm->rsp-3]);
 }
 static void p_UNLOOP(void){
-  if(rsp < 2){ out_err("UNLOOP RS underflow"); exit(1); }
+  if(vm->rsp < 2){ out_err("UNLOOP RS underflow"); vm_exit(1); }
   (void)rpop(); (void)rpop();
 }
 
 /* return stack ops */
 static void p_TOR(void){ rpush(dpop()); }
 static void p_RFROM(void){ dpush(rpop()); }
-static void p_RAT(void){ if(rsp<=0){ out_err("R@ underflow"); exit(1);} dpush(RS[rsp-1]); }
+static void p_RAT(void){ if(vm->rsp<=0){ out_err("R@ underflow"); vm_exit(1);} dpush(vm->RS[vm->rsp-1]); }
 
 /* data-space mgmt */
-static void p_HERE(void){ dpush((cell)here_data); }
+static void p_HERE(void){ dpush((cell)vm->here_data); }
 static void p_ALLOT(void){
   cell n = dpop();
-  if(n < 0){ out_err("ALLOT neg"); exit(1); }
-  if((ucell)n > (MEM_DATA_CELLS - here_data)){ out_err("data full"); exit(1); }
-  here_data = (ucell)(here_data + (ucell)n);
+  if(n < 0){ out_err("ALLOT neg"); vm_exit(1); }
+  if(vm->here_data + (ucell)n > vm->data_max){ runtime_recover("data full"); }
+  vm->here_data = (ucell)(vm->here_data + (ucell)n);
 }
 static void p_COMMA(void){ cell v=dpop(); dcomma(v); }
 
+/* ===== heap: ALLOCATE FREE RESIZE ===== */
+/*
+  Blocks in data_mem[DATA_TOP, MEM_DATA_CELLS) carry a header and a footer
+  cell: size in cells << 2 | HB_USED | HB_SMALL. Requests up to 16 cells get
+  a block of the next size class; freed, it goes back on that class's list
+  and is never merged. Larger blocks are cut first-fit from a doubly linked
+  free list (next, prev in the first two payload cells) and merged with free
+  neighbours when freed. Addresses are cells, as for ALLOT.
+*/
+enum { HB_USED = 1, HB_SMALL = 2, HB_MIN = 4 };
+static const ucell heap_class[HEAP_CLASSES] = { 2, 4, 8, 16 };   /* payload cells */
+enum { IOR_ALLOCATE = -59, IOR_FREE = -60, IOR_RESIZE = -61 };
+
+#define HB_HDR(b)  vm->data_mem[b]
+#define HB_SIZE(b) ((ucell)HB_HDR(b) >> 2)
+
+static void heap_mark(ucell b, ucell size, ucell flags){
+  HB_HDR(b) = (cell)(size << 2 | flags);
+  vm->data_mem[b + size - 1] = (cell)(size << 2 | flags);
+}
+static void heap_link(ucell b){
+  vm->data_mem[b + 1] = (cell)vm->heap_free;
+  vm->data_mem[b + 2] = 0;
+  if(vm->heap_free) vm->data_mem[vm->heap_free + 2] = (cell)b;
+  vm->heap_free = b;
+}
+static void heap_unlink(ucell b){
+  ucell next = (ucell)vm->data_mem[b + 1], prev = (ucell)vm->data_mem[b + 2];
+  if(prev) vm->data_mem[prev + 1] = (cell)next; else vm->heap_free = next;
+  if(next) vm->data_mem[next + 2] = (cell)prev;
+}
+static void heap_init(void){
+  if(vm->heap_ready) return;
+  vm->heap_ready = 1;
+  if((ucell)HEAP_CELLS < (ucell)HB_MIN) return;
+  heap_mark(DATA_TOP, HEAP_CELLS, 0);
+  heap_link(DATA_TOP);
+}
+/* first free large block of at least size cells, split; 0 if none. A block
+   that keeps a remainder too small to split off is no longer a size class. */
+static ucell heap_take(ucell size, ucell flags){
+  ucell b = vm->heap_free;
+  while(b && HB_SIZE(b) < size) b = (ucell)vm->data_mem[b + 1];
+  if(!b) return 0;
+  heap_unlink(b);
+  ucell rest = HB_SIZE(b) - size;
+  if(rest >= HB_MIN){
+    heap_mark(b + size, rest, 0);
+    heap_link(b + size);
+  }else if(rest){
+    size += rest;
+    flags &= ~(ucell)HB_SMALL;
+  }
+  heap_mark(b, size, flags);
+  return b;
+}
+/* payload address of a new block for u cells; 0 if the heap is full */
+static ucell heap_alloc(ucell u){
+  ucell b = 0;
+  heap_init();
+  if(u > (ucell)HEAP_CELLS) return 0;
+  int k = 0;
+  while(k < HEAP_CLASSES && heap_class[k] < u) k++;
+  if(k < HEAP_CLASSES){
+    b = vm->heap_small[k];
+    if(b){
+      vm->heap_small[k] = (ucell)vm->data_mem[b + 1];
+      heap_mark(b, HB_SIZE(b), HB_USED | HB_SMALL);
+    }else{
+      b = heap_take(heap_class[k] + 2, HB_USED | HB_SMALL);
+    }
+  }else{
+    b = heap_take(u + 2, HB_USED);
+  }
+  if(!b) return 0;
+  vm->heap_used += HB_SIZE(b);
+  if(vm->heap_used > vm->heap_high) vm->heap_high = vm->heap_used;
+  return b + 1;
+}
+/* block of an allocated payload address, 0 if a is not one */
+static ucell heap_block(cell a){
+  ucell b = (ucell)a - 1;
+  if(!vm->heap_ready || a <= DATA_TOP || (ucell)a >= (ucell)MEM_DATA_CELLS) return 0;
+  ucell size = HB_SIZE(b);
+  if(!(HB_HDR(b) & HB_USED) || size < HB_MIN || size > (ucell)MEM_DATA_CELLS - b ||
+     vm->data_mem[b + size - 1] != HB_HDR(b)) return 0;
+  return b;
+}
+static void heap_release(ucell b){
+  ucell size = HB_SIZE(b);
+  vm->heap_used -= size;
+  int k = 0;
+  while(k < HEAP_CLASSES && heap_class[k] + 2 != size) k++;
+  if((HB_HDR(b) & HB_SMALL) && k < HEAP_CLASSES){
+    heap_mark(b, size, HB_SMALL);
+    vm->data_mem[b + 1] = (cell)vm->heap_small[k];
+    vm->heap_small[k] = b;
+    return;
+  }
+  ucell next = b + size;
+  if(next < (ucell)MEM_DATA_CELLS && (HB_HDR(next) & 3) == 0){
+    heap_unlink(next);
+    size += HB_SIZE(next);
+  }
+  if(b > (ucell)DATA_TOP && (vm->data_mem[b - 1] & 3) == 0){
+    ucell prev = b - ((ucell)vm->data_mem[b - 1] >> 2);
+    heap_unlink(prev);
+    size += b - prev;
+    b = prev;
+  }
+  heap_mark(b, size, 0);
+  heap_link(b);
+}
+
+/* ALLOCATE ( u -- a-addr ior ) */
+static void p_ALLOCATE(void){
+  cell u = dpop();
+  ucell a = u < 0 ? 0 : heap_alloc(u == 0 ? 1u : (ucell)u);
+  dpush((cell)a);
+  dpush(a ? 0 : IOR_ALLOCATE);
+}
+/* FREE ( a-addr -- ior ) */
+static void p_FREE(void){
+  ucell b = heap_block(dpop());
+  if(b) heap_release(b);
+  dpush(b ? 0 : IOR_FREE);
+}
+/* RESIZE ( a-addr1 u -- a-addr2 ior ) grows in place into a free neighbour, else moves */
+static void p_RESIZE(void){
+  cell u = dpop();
+  cell a = dpop();
+  ucell b = heap_block(a);
+  if(!b || u < 0){ dpush(a); dpush(IOR_RESIZE); return; }
+  ucell have = HB_SIZE(b) - 2;
+  if((ucell)u <= have){ dpush(a); dpush(0); return; }
+  ucell next = b + HB_SIZE(b);
+  if(!(HB_HDR(b) & HB_SMALL) && next < (ucell)MEM_DATA_CELLS && (HB_HDR(next) & 3) == 0 &&
+     have + HB_SIZE(next) >= (ucell)u){
+    ucell size = HB_SIZE(b) + HB_SIZE(next);
+    ucell need = (ucell)u + 2;
+    heap_unlink(next);
+    vm->heap_used -= HB_SIZE(b);
+    if(size - need >= HB_MIN){
+      heap_mark(b + need, size - need, 0);
+      heap_link(b + need);
+      size = need;
+    }
+    heap_mark(b, size, HB_USED);
+    vm->heap_used += size;
+    if(vm->heap_used > vm->heap_high) vm->heap_high = vm->heap_used;
+    dpush(a);
+    dpush(0);
+    return;
+  }
+  ucell n = heap_alloc((ucell)u);
+  if(!n){ dpush(a); dpush(IOR_RESIZE); return; }
+  memcpy(&vm->data_mem[n], &vm->data_mem[(ucell)a], (size_t)have * sizeof(cell));
+  heap_release(b);
+  dpush((cell)n);
+  dpush(0);
+}
+/* HEAP-STATS ( -- ) cells used, peak, free, largest free block and fragmentation */
+static void p_HEAPSTATS(void){
+  ucell free_large = 0, largest = 0, free_small = 0;
+  heap_init();
+  for(ucell b=vm->heap_free; b; b=(ucell)vm->data_mem[b + 1]){
+    free_large += HB_SIZE(b);
+    if(HB_SIZE(b) > largest) largest = HB_SIZE(b);
+  }
+  for(int k=0;k<HEAP_CLASSES;k++)
+    for(ucell b=vm->heap_small[k]; b; b=(ucell)vm->data_mem[b + 1]) free_small += HB_SIZE(b);
+  ucell free_all = free_large + free_small;
+  out_str("heap ");        out_uint(HEAP_CELLS);
+  out_str(" used ");       out_uint(vm->heap_used);
+  out_str(" peak ");       out_uint(vm->heap_high);
+  out_str(" free ");       out_uint(free_all);
+  out_str(" largest ");    out_uint(largest);
+  out_str(" small-free "); out_uint(free_small);
+  out_str(" frag ");       out_uint(free_all ? 100u - (unsigned long)largest * 100u / free_all : 0u);
+  out_str("%");
+  out_nl();
+}
+
 /* code-space helpers */
-static void p_HEREC(void){ dpush((cell)here_code); }
+static void p_HEREC(void){ dpush((cell)vm->here_code); }
 static void p_CODEAT(void){
   cell a=dpop();
-  if(a < 0 || (ucell)a >= (ucell)MEM_CODE_CELLS){ out_err_i("CODE@ bad ", a); exit(1); }
-  dpush(code_mem[(ucell)a]);
+  if(a < 0 || (ucell)a >= (ucell)MEM_CODE_CELLS){ out_err_i("CODE@ bad ", a); vm_exit(1); }
+  dpush(vm->code_mem[(ucell)a]);
 }
 static void p_CODESTORE(void){
   cell a=dpop();
   cell v=dpop();
-  if(a < 0 || (ucell)a >= (ucell)MEM_CODE_CELLS){ out_err_i("CODE! bad ", a); exit(1); }
-  code_mem[(ucell)a] = v;
+  if(a < 0 || (ucell)a >= (ucell)MEM_CODE_CELLS){ out_err_i("CODE! bad ", a); vm_exit(1); }
+#if KFORTH_JIT
+  jit_invalidate((ucell)a);
+#endif
+#if KFORTH_APP
+  if((ucell)a < app_image.here_code) app_stale = 1;
+#endif
+#if KFORTH_PEEPHOLE
+  untail((ucell)a);
+#endif
+  vm->code_mem[(ucell)a] = v;
+#if KFORTH_INLINE_CELLS
+  /* callers compiled from now on call a patched body; copies inlined before keep the old cells */
+  int owner = code_owner((ucell)a);
+  if(owner >= 0 && !(vm->compiling && owner == vm->current_def)) vm->dict[owner].noinline = 1;
+#endif
 }
 static void p_CCOMMA(void){ cell v=dpop(); ccomma(v); }
 
+/* pop ( addr len ) naming a file into path[256] */
+static void pop_path(char *path, const char *bad_name, const char *bad_addr){
+  cell len = dpop();
+  cell addr = dpop();
+  if(len <= 0 || len >= 256){ runtime_recover(bad_name); }
+  ucell a = data_span(addr, len, bad_addr);
+  for(cell i=0;i<len;i++) path[i] = (char)fetch_byte(a + (ucell)i);
+  path[len] = 0;
+}
+
 /* I/O */
-static void p_EMIT(void){ cell v=dpop(); mf_emit((uint8_t)v); }
-static void p_KEY(void){ int c=mf_key(); if(c<0) dpush(0); else dpush((cell)(c & 0xFF)); }
+static void p_EMIT(void){ cell v=dpop(); vm_emit((uint8_t)v); }
+static void p_KEY(void){
+#if KFORTH_TASKS
+  if(vm->task_cur >= 0 && !vm->src && !mf_key_ready() && task_retry(XT_KEY)) return;
+#endif
+  int c=vm_key(); if(c<0) dpush(0); else dpush((cell)(c & 0xFF));
+}
 static void p_DOT(void){ cell v=dpop(); out_int((int)v); out_ch(' '); }
 static void p_IOAT(void){
   cell h = dpop();
   int32_t b = 0;
   int ok = kf_io_at((int32_t)h, &b);
+#if KFORTH_TASKS
+  if(!ok && vm->task_n){   /* no data yet: the operator runs the tasks and looks again */
+    if(vm->task_cur < 0){ if(task_round()) ok = kf_io_at((int32_t)h, &b); }
+    else (void)task_leave(TS_READY);
+  }
+#endif
   dpush((cell)b);
   dpush(ok ? (cell)-1 : (cell)0);
 }
@@ -571,45 +1853,359 @@ static void p_IOCTL(void){
   dpush((cell)y);
   dpush(ok ? (cell)-1 : (cell)0);
 }
+
+/* IO-OPEN ( addr len mode -- h f ) */
+static void p_IOOPEN(void){
+  char path[256];
+  cell mode = dpop();
+  int32_t h = 0;
+  pop_path(path, "IO-OPEN bad name", "IO-OPEN bad ");
+  int ok = kf_io_open(path, (int32_t)mode, &h);
+  dpush((cell)h);
+  dpush(ok ? (cell)-1 : (cell)0);
+}
+static void p_IOCLOSE(void){ cell h = dpop(); dpush(kf_io_close((int32_t)h) ? (cell)-1 : (cell)0); }
+/* READ-BLOCK / WRITE-BLOCK ( addr len h -- n f ) move bytes between data space and a
+   device in one call, without blocking */
+static void p_READBLOCK(void){
+  cell h = dpop();
+  cell len = dpop();
+  ucell a = data_span(dpop(), len, "READ-BLOCK bad ");
+  int32_t n = 0;
+  int ok = kf_io_read((int32_t)h, DATA_BYTES + a, (int32_t)len, &n);
+  dpush((cell)n);
+  dpush(ok ? (cell)-1 : (cell)0);
+}
+static void p_WRITEBLOCK(void){
+  cell h = dpop();
+  cell len = dpop();
+  const uint8_t *a = fetch_span(dpop(), len, "WRITE-BLOCK bad ");
+  int32_t n = 0;
+  int ok = kf_io_write((int32_t)h, a, (int32_t)len, &n);
+  dpush((cell)n);
+  dpush(ok ? (cell)-1 : (cell)0);
+}
+/* IO-WAIT ( mask timeout -- ready ) wait up to timeout ms (-1: no limit) for readable handles */
+static void p_IOWAIT(void){
+  cell timeout = dpop();
+  cell mask = dpop();
+  uint32_t ready = 0;
+#if KFORTH_TASKS
+  if(timeout != 0 && vm->task_cur >= 0){   /* a task waits by giving up the CPU */
+    cell *b = &vm->data_mem[vm->task_blk[vm->task_cur]];
+    if(!b[TK_RETRY]) b[TK_WAKE] = (cell)(kf_ms() + (uint32_t)timeout);
+    b[TK_RETRY] = 0;
+    if(kf_io_wait((uint32_t)mask, 0, &ready) && !ready &&
+       (timeout < 0 || (int32_t)(kf_ms() - (uint32_t)b[TK_WAKE]) < 0)){
+      if(task_retry(XT_IOWAIT)){
+        b[TK_RETRY] = 1;
+        dpush(mask);
+        dpush(timeout);
+        return;
+      }
+      (void)kf_io_wait((uint32_t)mask, (int32_t)timeout, &ready);
+    }
+    dpush((cell)ready);
+    return;
+  }
+  if(timeout != 0 && task_live()){         /* the operator runs the tasks meanwhile */
+    uint32_t wake = kf_ms() + (uint32_t)timeout;
+    while(kf_io_wait((uint32_t)mask, 0, &ready) && !ready && (timeout < 0 || (int32_t)(kf_ms() - wake) < 0)){
+      if(!task_round()) (void)kf_io_wait((uint32_t)mask, 1, &ready);
+      vm_flush();
+    }
+    dpush((cell)ready);
+    return;
+  }
+#endif
+  (void)kf_io_wait((uint32_t)mask, (int32_t)timeout, &ready);
+  dpush((cell)ready);
+}
+
+#if KFORTH_FILES
+/* ===== files ===== */
+/*
+  fileid is 1..FILES_MAX and ior is 0 or the host errno (-1 when there is
+  none). fam is R/O W/O or R/W; BIN is accepted and changes nothing. Each
+  open file goes through its own KFORTH_FILE_BUF byte stdio buffer.
+*/
+#include <errno.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define KF_MMAP 1
+#else
+#define KF_MMAP 0
+#endif
+
+static cell file_ior(void){ return errno ? (cell)errno : -1; }
+static FILE *file_get(cell id){ return (id > 0 && id <= FILES_MAX) ? vm->file[id - 1] : NULL; }
+
+static void p_RO(void){ dpush(0); }
+static void p_WO(void){ dpush(1); }
+static void p_RW(void){ dpush(2); }
+static void p_BIN(void){ }
+
+/* OPEN-FILE / CREATE-FILE ( c-addr u fam -- fileid ior ) */
+static void file_open(int create){
+  static const char *const modes[2][3] = { { "rb", "r+b", "r+b" }, { "w+b", "wb", "w+b" } };
+  char path[256];
+  cell fam = dpop() & ~4;
+  pop_path(path, "OPEN-FILE bad name", "OPEN-FILE bad ");
+  int id = 0;
+  while(id < FILES_MAX && vm->file[id]) id++;
+  errno = 0;
+  FILE *f = (id < FILES_MAX && fam >= 0 && fam < 3) ? fopen(path, modes[create][fam]) : NULL;
+  if(!f){ dpush(0); dpush(file_ior()); return; }
+  setvbuf(f, NULL, _IOFBF, KFORTH_FILE_BUF);
+  vm->file[id] = f;
+  dpush((cell)id + 1);
+  dpush(0);
+}
+static void p_OPENFILE(void){ file_open(0); }
+static void p_CREATEFILE(void){ file_open(1); }
+/* CLOSE-FILE ( fileid -- ior ) */
+static void p_CLOSEFILE(void){
+  cell id = dpop();
+  FILE *f = file_get(id);
+  if(!f){ dpush(-1); return; }
+  vm->file[id - 1] = NULL;
+  errno = 0;
+  dpush(fclose(f) == 0 ? 0 : file_ior());
+}
+/* READ-FILE ( c-addr u1 fileid -- u2 ior ) */
+static void p_READFILE(void){
+  FILE *f = file_get(dpop());
+  cell len = dpop();
+  ucell a = data_span(dpop(), len, "READ-FILE bad ");
+  if(!f){ dpush(0); dpush(-1); return; }
+  errno = 0;
+  size_t n = fread(DATA_BYTES + a, 1, (size_t)len, f);
+  dpush((cell)n);
+  dpush(ferror(f) ? file_ior() : 0);
+}
+/* READ-LINE ( c-addr u1 fileid -- u2 flag ior ) the line end (LF or CR LF) is not stored */
+static void p_READLINE(void){
+  FILE *f = file_get(dpop());
+  cell len = dpop();
+  uint8_t *p = DATA_BYTES + data_span(dpop(), len, "READ-LINE bad ");
+  if(!f){ dpush(0); dpush(0); dpush(-1); return; }
+  size_t n = 0;
+  int c = 0;
+  errno = 0;
+  while(n < (size_t)len && (c = getc(f)) != EOF && c != '\n') p[n++] = (uint8_t)c;
+  if(c == '\n' && n > 0 && p[n - 1] == '\r') n--;
+  dpush((cell)n);
+  dpush(c == EOF && n == 0 ? 0 : (cell)-1);
+  dpush(ferror(f) ? file_ior() : 0);
+}
+/* WRITE-FILE / WRITE-LINE ( c-addr u fileid -- ior ) */
+static void file_write(int line){
+  FILE *f = file_get(dpop());
+  cell len = dpop();
+  const uint8_t *p = fetch_span(dpop(), len, "WRITE-FILE bad ");
+  if(!f){ dpush(-1); return; }
+  errno = 0;
+  int ok = fwrite(p, 1, (size_t)len, f) == (size_t)len && (!line || putc('\n', f) != EOF);
+  dpush(ok ? 0 : file_ior());
+}
+static void p_WRITEFILE(void){ file_write(0); }
+static void p_WRITELINE(void){ file_write(1); }
+static void push_ud(long v){
+  dpush((cell)(uint32_t)v);
+  dpush((cell)(uint32_t)((uint64_t)v >> 32));
+}
+/* FILE-SIZE / FILE-POSITION ( fileid -- ud ior ) */
+static void p_FILESIZE(void){
+  FILE *f = file_get(dpop());
+  long at = -1, end = -1;
+  errno = 0;
+  if(f && (at = ftell(f)) >= 0 && fseek(f, 0, SEEK_END) == 0){
+    end = ftell(f);
+    if(fseek(f, at, SEEK_SET) != 0) end = -1;
+  }
+  push_ud(end < 0 ? 0 : end);
+  dpush(end < 0 ? file_ior() : 0);
+}
+static void p_FILEPOSITION(void){
+  FILE *f = file_get(dpop());
+  errno = 0;
+  long at = f ? ftell(f) : -1;
+  push_ud(at < 0 ? 0 : at);
+  dpush(at < 0 ? file_ior() : 0);
+}
+/* REPOSITION-FILE ( ud fileid -- ior ) */
+static void p_REPOSITIONFILE(void){
+  FILE *f = file_get(dpop());
+  uint64_t hi = (ucell)dpop();
+  uint64_t at = hi << 32 | (ucell)dpop();
+  errno = 0;
+  dpush(f && at <= (uint64_t)(~0ul >> 1) && fseek(f, (long)at, SEEK_SET) == 0 ? 0 : file_ior());
+}
+
+static void map_drop(kf_vm *v){
+#if KF_MMAP
+  if(v->map_mem) munmap((void *)v->map_mem, v->map_len);
+#endif
+  v->map_mem = NULL;
+  v->map_len = 0;
+}
+/* MAP-FILE ( c-addr u -- addr len ior ) map a file read-only at MAP_BASE, replacing the last one */
+static void p_MAPFILE(void){
+  char path[256];
+  cell ior = -1;
+  pop_path(path, "MAP-FILE bad name", "MAP-FILE bad ");
+  map_drop(vm);
+#if KF_MMAP
+  struct stat st;
+  errno = 0;
+  int fd = open(path, O_RDONLY);
+  if(fd >= 0 && fstat(fd, &st) == 0 && (uint64_t)st.st_size <= (uint64_t)MAP_MAX){
+    void *m = st.st_size > 0 ? mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    if(m != MAP_FAILED){
+      vm->map_mem = (const uint8_t *)m;
+      vm->map_len = (size_t)st.st_size;
+      ior = 0;
+    }
+  }
+  if(ior) ior = file_ior();
+  if(fd >= 0) close(fd);
+#endif
+  dpush(ior ? 0 : (cell)MAP_BASE);
+  dpush((cell)vm->map_len);
+  dpush(ior);
+}
+
+#if KFORTH_MULTI_VM
+/* kf_vm_destroy(): close what the VM left open (a single VM leaves it to exit) */
+static void files_close(kf_vm *v){
+  for(int i=0;i<FILES_MAX;i++){
+    if(v->file[i]) fclose(v->file[i]);
+    v->file[i] = NULL;
+  }
+  map_drop(v);
+}
+#endif
+#endif
+
+#if KFORTH_TASKS
+/* tasks */
+static void p_PAUSE(void){
+  if(vm->task_cur < 0) (void)task_round();
+  else (void)task_leave(TS_READY);
+}
+/* STOP: the running task sleeps until ACTIVATEd again; in the operator, PAUSE */
+static void p_STOP(void){
+  if(vm->task_cur < 0) (void)task_round();
+  else (void)task_leave(TS_STOPPED);
+}
+/* MS ( n -- ) wait n milliseconds, letting the other tasks run */
+static void p_MS(void){
+  cell n = dpop();
+  uint32_t wake = kf_ms() + (uint32_t)(n > 0 ? n : 0);
+  if(vm->task_cur >= 0){
+    vm->data_mem[vm->task_blk[vm->task_cur] + TK_WAKE] = (cell)wake;
+    if(task_leave(TS_ASLEEP)) return;
+  }
+  while((int32_t)(kf_ms() - wake) < 0){
+    if(!task_round()){ vm_flush(); kf_idle(); }
+  }
+}
+/* TASK name : a task block; name ( -- task ) */
+#if !KFORTH_APP
+static void p_TASK(void){
+  char name[128];
+  if(!next_token(name, sizeof(name))){ out_err("TASK needs name"); return; }
+  if(vm->here_data + TK_CELLS > vm->data_max){ runtime_recover("data full"); }
+  ucell t = vm->here_data;
+  int wi = add_word(name, XT_DOVAR, 0);
+  vm->dict[wi].pfa = t;
+  memset(&vm->data_mem[t], 0, (size_t)TK_CELLS * sizeof(cell));
+  vm->data_mem[t + TK_TAG] = TASK_TAG;
+  vm->here_data = t + TK_CELLS;
+}
+#endif
+/* ACTIVATE ( task -- ) the rest of the definition runs as task; return to the caller */
+static void p_ACTIVATE(void){
+  cell t = dpop();
+  if(t < 0 || (ucell)t > (ucell)(MEM_DATA_CELLS - TK_CELLS) || vm->data_mem[t + TK_TAG] != TASK_TAG){
+    runtime_recover("ACTIVATE not a task");
+  }
+  if(!vm->running){ runtime_recover("ACTIVATE outside a definition"); }
+  int i = 0;
+  while(i < vm->task_n && vm->task_blk[i] != (ucell)t) i++;
+  if(i == vm->task_cur){ runtime_recover("ACTIVATE of the running task"); }
+  if(i == vm->task_n){
+    if(vm->task_n >= TASKS_MAX){ runtime_recover("too many tasks"); }
+    vm->task_blk[vm->task_n++] = (ucell)t;
+  }
+  cell *b = &vm->data_mem[t];
+  b[TK_IP] = (cell)vm->ip;
+  b[TK_DSP] = 0;
+  b[TK_RSP] = 1;
+  b[TK_RS] = 0;   /* its final EXIT pops this and ends the task */
+  b[TK_RETRY] = 0;
+  b[TK_STATUS] = TS_READY;
+  p_EXIT();
+}
+#if !KFORTH_APP
+/* USER name : a variable each task has its own copy of; name ( -- addr ) */
+static void p_USER(void){
+  char name[128];
+  if(!next_token(name, sizeof(name))){ out_err("USER needs name"); return; }
+  ucell off = 0;
+  for(int i=0;i<vm->dict_n;i++){
+    if(vm->dict[i].cfa == XT_DOUSER && vm->dict[i].pfa >= off) off = vm->dict[i].pfa + 1;
+  }
+  if(off >= TASK_USER){ out_err("user area full"); return; }
+  int wi = add_word(name, XT_DOUSER, 0);
+  vm->dict[wi].pfa = off;
+}
+#endif
+static void p_DOUSER(void){ dpush((cell)(vm->task_up + vm->dict[vm->current_wi].pfa)); }
+#endif
 static void p_TYPEP(void){
   cell len = dpop();
   cell addr = dpop();
-  if(len < 0){ out_err("TYPE bad len"); exit(1); }
-  for(int i=0;i<len;i++) mf_emit(fetch_byte((ucell)((cell)addr + i)));
+  if(len < 0){ out_err("TYPE bad len"); vm_exit(1); }
+  vm_write(fetch_span(addr, len, "TYPE bad "), (size_t)len);
 }
 static void p_PROMPTON(void){
   /* Enter interactive mode with clean stacks/state. */
-  dsp = 0;
-  rsp = 0;
-  compiling = 0;
-  current_def = -1;
-  data_mem[A_STATE] = 0;
-  prompt_mode = 1;
+  vm->dsp = 0;
+  vm->rsp = 0;
+  vm->compiling = 0;
+  vm->current_def = -1;
+  vm->data_mem[A_STATE] = 0;
+  vm->prompt_mode = 1;
 }
 static void p_PROMPTOFF(void){
-  prompt_mode = 0;
+  vm->prompt_mode = 0;
 }
-static void p_BYE(void){ exit(0); }
+static void p_BYE(void){ vm_exit(0); }
+static void p_FLUSH(void){ vm_flush(); }
 static void p_ABORTQ(void){
   cell len = dpop();
   cell addr = dpop();
   cell flag = dpop();
   if(flag == 0) return;
-  if(len < 0){ out_err("ABORT\" bad len"); exit(1); }
-  mf_emit('\n');
-  for(int i=0;i<len;i++) mf_emit(fetch_byte((ucell)((cell)addr + i)));
+  if(len < 0){ out_err("ABORT\" bad len"); vm_exit(1); }
+  vm_emit('\n');
+  out_bytes(data_span(addr, len, "ABORT\" bad "), (ucell)len);
   p_ABORT();
 }
+#if !KFORTH_APP
 static void p_SQUOTE(void){
   char buf[1024];
   int len = 0;
   if(!read_quoted(buf, sizeof(buf), &len)) return;
-  cell addr = alloc_string_data(buf, len);
-  if(data_mem[A_STATE] != 0){
-    compile_lit_cell(addr);
+  if(vm->data_mem[A_STATE] != 0){
+    compile_lit_cell(alloc_string_data(buf, len));
     compile_lit_cell((cell)len);
   }else{
-    dpush(addr);
+    dpush(alloc_transient(buf, len));
     dpush((cell)len);
   }
 }
@@ -617,64 +2213,58 @@ static void p_DOTQUOTE(void){
   char buf[1024];
   int len = 0;
   if(!read_quoted(buf, sizeof(buf), &len)) return;
-  cell addr = alloc_string_data(buf, len);
-  if(data_mem[A_STATE] != 0){
-    if(WI_TYPE < 0){ out_err("no TYPE"); exit(1); }
-    compile_lit_cell(addr);
+  if(vm->data_mem[A_STATE] != 0){
+    if(WI_TYPE < 0){ out_err("no TYPE"); vm_exit(1); }
+    compile_lit_cell(alloc_string_data(buf, len));
     compile_lit_cell((cell)len);
     compile_wordtok(WI_TYPE);
   }else{
-    for(int i=0;i<len;i++) mf_emit((uint8_t)buf[i]);
+    vm_write((const uint8_t *)buf, (size_t)len);
   }
 }
 static void p_ABORTQUOTE(void){
   char buf[1024];
   int len = 0;
   if(!read_quoted(buf, sizeof(buf), &len)) return;
-  cell addr = alloc_string_data(buf, len);
-  if(data_mem[A_STATE] != 0){
-    if(WI_ABORTQ < 0){ out_err("no (ABORT\")"); exit(1); }
-    compile_lit_cell(addr);
+  if(vm->data_mem[A_STATE] != 0){
+    if(WI_ABORTQ < 0){ out_err("no (ABORT\")"); vm_exit(1); }
+    compile_lit_cell(alloc_string_data(buf, len));
     compile_lit_cell((cell)len);
     compile_wordtok(WI_ABORTQ);
   }else{
     cell flag = dpop();
     if(flag == 0) return;
-    mf_emit('\n');
-    for(int i=0;i<len;i++) mf_emit((uint8_t)buf[i]);
+    vm_emit('\n');
+    vm_write((const uint8_t *)buf, (size_t)len);
     p_ABORT();
   }
 }
+#endif
 
 /* EXECUTE: word-token or primitive xt */
 static void p_EXECUTE(void){
   cell x = dpop();
   if(IS_WORDTOK(x)){
     int wi = WORD_ID(x);
-    Word *w = &dict[wi];
-    if((w->cfa == XT_DOCOL || w->cfa == XT_DODOES) && !running){
-      ucell saved_ip = ip;
-      ip = 0;
-      exec_word(wi);
-      run_thread();
-      ip = saved_ip;
+    Word *w = &vm->dict[wi];
+    if((w->cfa == XT_DOCOL || w->cfa == XT_DODOES) && !vm->running){
+      execute_wi(wi);
     }else{
       exec_word(wi);
     }
   }else{
     ucell xt=(ucell)x;
-    if(xt >= (ucell)prim_n){ out_err("EXECUTE bad xt"); exit(1); }
+    if(xt >= (ucell)prim_n){ out_err("EXECUTE bad xt"); vm_exit(1); }
     prim_table[xt]();
   }
 }
 
-/* comment: ( ... ) reads from stdin via mf_key */
+#if !KFORTH_APP
+/* comment: ( ... ) skips stdin input through ) */
 static void p_PAREN_COMMENT(void){
-  int c;
-  while((c = mf_key()) != -1){
-    if(c == ')') break;
-  }
+  (void)in_skip_past(')');
 }
+#endif
 
 /* REPL interface primitives */
 static void p_STATE(void){ dpush((cell)A_STATE); }
@@ -684,62 +2274,64 @@ static void p_NTIB(void){ dpush((cell)A_NTIB); }
 static void p_TIB(void){ dpush((cell)(A_TIB * (ucell)CELL_BYTES)); } /* byte address */
 
 /* [ ] */
-static void p_LBRACK(void){ data_mem[A_STATE] = 0; }
+static void p_LBRACK(void){ vm->data_mem[A_STATE] = 0; }
 static void p_RBRACK(void){
-  if(current_def >= 0) data_mem[A_STATE] = 1;
+  if(vm->current_def >= 0) vm->data_mem[A_STATE] = 1;
 }
 
 /* REFILL: read a line into TIB; returns flag */
 static void p_REFILL(void){
   ucell n=0;
-  int c;
   while(1){
-    c = mf_key();
-    if(c < 0){
-      if(n==0){ data_mem[A_NTIB]=0; dpush(0); return; }
+    size_t len;
+    const uint8_t *p = vm_in_window(&len);
+    if(len == 0){
+      if(n==0){ vm->data_mem[A_NTIB]=0; dpush(0); return; }
       break;
     }
-    if(c=='\r') continue;
-    if(c=='\n') break;
-    if(n < (TIB_BYTES-1)){
-      store_byte((ucell)(A_TIB*(ucell)CELL_BYTES) + n, (uint8_t)(c & 0xFF));
+    const uint8_t *q = memchr(p, '\n', len);
+    size_t k = q ? (size_t)(q - p) : len;
+    for(size_t i=0;i<k;i++){
+      if(p[i]=='\r' || n >= (TIB_BYTES-1)) continue;
+      store_byte((ucell)(A_TIB*(ucell)CELL_BYTES) + n, p[i]);
       n++;
     }
+    vm_in_consume(q ? k + 1 : k);
+    if(q) break;
   }
   store_byte((ucell)(A_TIB*(ucell)CELL_BYTES) + n, 0);
-  data_mem[A_NTIB] = (cell)n;
-  data_mem[A_IN]   = 0;
+  vm->data_mem[A_NTIB] = (cell)n;
+  vm->data_mem[A_IN]   = 0;
   dpush(1);
 }
 
 /* SOURCE: ( -- addr len ) */
 static void p_SOURCE(void){
   dpush((cell)(A_TIB*(ucell)CELL_BYTES));
-  dpush(data_mem[A_NTIB]);
+  dpush(vm->data_mem[A_NTIB]);
 }
 
 /* PARSE: ( delim -- addr len ) using SOURCE and >IN */
 static void p_PARSE(void){
   cell delim = dpop();
   ucell base = (ucell)(A_TIB*(ucell)CELL_BYTES);
-  ucell ntib = (ucell)data_mem[A_NTIB];
-  ucell in   = (ucell)data_mem[A_IN];
+  ucell ntib = (ucell)vm->data_mem[A_NTIB];
+  ucell in   = (ucell)vm->data_mem[A_IN];
 
   if(in >= ntib){
     char buf[1024];
     int c;
     int n = 0;
     while(1){
-      c = mf_key();
+      c = vm_key();
       if(c < 0 || c == '\n') break;
       if((uint8_t)c != (uint8_t)(delim & 0xFF)) break;
     }
     while(c >= 0 && c != '\n' && (uint8_t)c != (uint8_t)(delim & 0xFF)){
       if(n < (int)sizeof(buf)-1) buf[n++] = (char)c;
-      c = mf_key();
+      c = vm_key();
     }
-    cell addr = alloc_string_data(buf, n);
-    dpush(addr);
+    dpush(alloc_transient(buf, n));
     dpush((cell)n);
     return;
   }
@@ -749,114 +2341,149 @@ static void p_PARSE(void){
   while(in < ntib && fetch_byte(base + in) != (uint8_t)(delim & 0xFF)) in++;
   ucell len = in - start;
   if(in < ntib && fetch_byte(base + in) == (uint8_t)(delim & 0xFF)) in++;
-  data_mem[A_IN] = (cell)in;
+  vm->data_mem[A_IN] = (cell)in;
 
   dpush((cell)(base + start));
   dpush((cell)len);
 }
 
+#if !KFORTH_APP
 /* FIND: ( addr len -- xt 1 | xt -1 | 0 )  xt is word-token */
 static void p_FIND(void){
   cell len=dpop();
   cell addr=dpop();
   if(len <= 0){ dpush(0); return; }
 
-  char buf[NAME_MAX+1];
+  /* hash and compare in place; names longer than NAME_MAX match truncated */
   int n = (len > NAME_MAX) ? NAME_MAX : (int)len;
-  for(int i=0;i<n;i++) buf[i] = (char)fetch_byte((ucell)addr + (ucell)i);
-  buf[n]=0;
-
-  int wi = find_word_cstr(buf);
+  uint32_t h = NAME_HASH_SEED;
+  for(int i=0;i<n;i++) h = name_hash_step(h, fetch_byte((ucell)addr + (ucell)i));
+  int wi = vm->dict_hash[h & (DICT_HASH-1)];
+  for(; wi!=-1; wi=vm->dict[wi].hnext){
+    if(vm->dict[wi].hash != h || vm->dict[wi].len != n) continue;
+    int i = 0;
+    while(i < n && (uint8_t)vm->dict[wi].name[i] == fetch_byte((ucell)addr + (ucell)i)) i++;
+    if(i == n) break;
+  }
   if(wi < 0) dpush(0);
   else{
     dpush(MK_WORDTOK(wi));
-    dpush(dict[wi].immediate ? (cell)-1 : (cell)1);
+    dpush(vm->dict[wi].immediate ? (cell)-1 : (cell)1);
   }
 }
 
-/* ' : uses PARSE BL then FIND, leaves xt */
-static void p_TICK(void){
+/* next name from TIB (Forth INTERPRET) or stdin (C outer interpreter); -1 if unknown */
+static int tick_wi(void){
   char tok[128];
-  ucell ntib = (ucell)data_mem[A_NTIB];
-  ucell in   = (ucell)data_mem[A_IN];
+  ucell ntib = (ucell)vm->data_mem[A_NTIB];
+  ucell in   = (ucell)vm->data_mem[A_IN];
 
   if(in < ntib){
     dpush(32);
     p_PARSE();
     p_FIND();
     cell f = dpop();
-    if(f!=0) return; /* xt is already on stack */
+    if(f!=0) return WORD_ID(dpop());
   }
 
-  if(!next_token(tok, sizeof(tok))){ out_err("' ?"); exit(1); }
-  int wi = find_word_cstr(tok);
-  if(wi < 0){ out_err("' ?"); exit(1); }
+  if(!next_token(tok, sizeof(tok))) return -1;
+  return find_word_cstr(tok);
+}
+
+/* ' : uses PARSE BL then FIND, leaves xt */
+static void p_TICK(void){
+  int wi = tick_wi();
+  if(wi < 0){ out_err("' ?"); vm_exit(1); }
   dpush(MK_WORDTOK(wi));
 }
 
 static void p_BRACKTICK(void){
-  if(data_mem[A_STATE] == 0){
+  if(vm->data_mem[A_STATE] == 0){
     out_err("['] outside compile");
     return;
   }
   p_TICK();
   compile_lit_cell(dpop());
 }
+#endif
 
 /* POSTPONE: compile next xt regardless of immediate */
 static void p_XPOSTPONE(void){
   cell xt = dpop();
-  if(!IS_WORDTOK(xt)){ out_err("POSTPONE bad xt"); exit(1); }
+  if(!IS_WORDTOK(xt)){ out_err("POSTPONE bad xt"); vm_exit(1); }
   int wi = WORD_ID(xt);
-  if(wi < 0 || wi >= dict_n){ out_err("POSTPONE bad wi"); exit(1); }
-  if(data_mem[A_STATE] != 0){
-    if(dict[wi].immediate) execute_wi(wi);
+  if(wi < 0 || wi >= vm->dict_n){ out_err("POSTPONE bad wi"); vm_exit(1); }
+  if(vm->data_mem[A_STATE] != 0){
+    if(vm->dict[wi].immediate) execute_wi(wi);
     else compile_wordtok(wi);
   }else{
     execute_wi(wi);
   }
 }
 
+#if !KFORTH_APP
 static void p_POSTPONE(void){
-  char tok[128];
-  cell xt;
-  ucell ntib = (ucell)data_mem[A_NTIB];
-  ucell in   = (ucell)data_mem[A_IN];
+  int wi = tick_wi();
+  if(wi < 0){ out_err("POSTPONE ?"); vm_exit(1); }
+  if(vm->data_mem[A_STATE] == 0){
+    out_err("POSTPONE outside compile");
+    return;
+  }
+  compile_lit_cell(MK_WORDTOK(wi));
+  if(XT_XPOSTPONE >= (ucell)prim_n){ out_err("no (POSTPONE)"); vm_exit(1); }
+  ccomma((cell)XT_XPOSTPONE);
+}
 
-  if(in < ntib){
+/* ===== conditional compilation: [IF] [ELSE] [THEN] [DEFINED] [UNDEFINED] ===== */
+/* next blank-delimited name from TIB or stdin into buf; 0 at end of input */
+static int next_name(char *buf, size_t bufsz){
+  if((ucell)vm->data_mem[A_IN] < (ucell)vm->data_mem[A_NTIB]){
     dpush(32);
     p_PARSE();
-    p_FIND();
-    cell f = dpop();
-    if(f!=0){
-      xt = dpop();
-    }else{
-      if(!next_token(tok, sizeof(tok))){ out_err("POSTPONE ?"); exit(1); }
-      int wi = find_word_cstr(tok);
-      if(wi < 0){ out_err("POSTPONE ?"); exit(1); }
-      xt = MK_WORDTOK(wi);
+    cell len = dpop();
+    cell addr = dpop();
+    if(len > 0){
+      size_t n = ((size_t)len < bufsz) ? (size_t)len : bufsz - 1;
+      for(size_t i=0;i<n;i++) buf[i] = (char)fetch_byte((ucell)addr + (ucell)i);
+      buf[n] = 0;
+      return 1;
     }
-  }else{
-    if(!next_token(tok, sizeof(tok))){ out_err("POSTPONE ?"); exit(1); }
-    int wi = find_word_cstr(tok);
-    if(wi < 0){ out_err("POSTPONE ?"); exit(1); }
-    xt = MK_WORDTOK(wi);
   }
-  if(data_mem[A_STATE] == 0){
-    out_err("POSTPONE outside compile");
-    return;
+  return next_token(buf, bufsz);
+}
+
+/* skip to the matching [THEN] (or [ELSE] when else_ok) */
+static void skip_cond(int else_ok){
+  char tok[128];
+  int depth = 0;
+  while(next_name(tok, sizeof(tok))){
+    if(strcmp(tok, "[IF]") == 0) depth++;
+    else if(strcmp(tok, "[ELSE]") == 0){ if(depth == 0 && else_ok) return; }
+    else if(strcmp(tok, "[THEN]") == 0){ if(depth-- == 0) return; }
   }
-  compile_lit_cell(xt);
-  if(XT_XPOSTPONE >= (ucell)prim_n){ out_err("no (POSTPONE)"); exit(1); }
-  ccomma((cell)XT_XPOSTPONE);
 }
 
+static void p_BRACKIF(void){ if(dpop() == 0) skip_cond(1); }
+static void p_BRACKELSE(void){ skip_cond(0); }
+static void p_BRACKTHEN(void){ }
+static int defined_next(void){
+  char tok[128];
+  return next_name(tok, sizeof(tok)) && find_word_cstr(tok) >= 0;
+}
+static void p_DEFINED(void){ dpush(defined_next() ? (cell)-1 : 0); }
+static void p_UNDEFINED(void){ dpush(defined_next() ? 0 : (cell)-1); }
+#endif
+
 static void p_XDOES(void){
-  if(last_created < 0){ out_err("(DOES>) no CREATE"); exit(1); }
-  dict[last_created].cfa = XT_DODOES;
-  dict[last_created].does_ip = ip;
-  ip = (ucell)rpop();
-  if(rsp == 0) running = 0;
+  if(vm->last_created < 0){ out_err("(DOES>) no CREATE"); vm_exit(1); }
+#if KFORTH_JIT
+  /* native code that inlined the old behaviour, or runs the old does_ip */
+  if(vm->jit_dep[vm->last_created] || vm->jit_fn[vm->last_created]) jit_flush();
+#endif
+  vm->dict[vm->last_created].cfa = XT_DODOES;
+  vm->dict[vm->last_created].does_ip = vm->ip;
+  vm->ip = (ucell)rpop();
+  if(vm->rsp == vm->rs_base) vm->running = 0;
 }
 
 /* >NUMBER: ( u addr len -- u' addr' len' ) in BASE, unsigned cell-width */
@@ -871,7 +2498,7 @@ static void p_TONUMBER(void){
   ucell addr = (ucell)dpop();
   ucell acc = (ucell)dpop();
 
-  ucell base = (ucell)data_mem[A_BASE];
+  ucell base = (ucell)vm->data_mem[A_BASE];
   if(base < 2 || base > 36) base = 10;
 
   ucell i=0;
@@ -913,7 +2540,7 @@ static void p_NUMBERQ(void){
     }
   }
 
-  ucell base = (ucell)data_mem[A_BASE];
+  ucell base = (ucell)vm->data_mem[A_BASE];
   if(base < 2 || base > 36) base = 10;
 
   ucell acc = 0;
@@ -936,13 +2563,13 @@ static void p_NUMBERQ(void){
 
 /* ABORT: reset stacks, keep VM running, discard rest of line */
 static void p_ABORT(void){
-  dsp = 0;
-  rsp = 0;
-  compiling = 0;
-  current_def = -1;
-  data_mem[A_STATE] = 0;
-  data_mem[A_IN] = data_mem[A_NTIB];
-  running = 0;
+  vm->dsp = 0;
+  vm->rsp = 0;
+  vm->compiling = 0;
+  vm->current_def = -1;
+  vm->data_mem[A_STATE] = 0;
+  vm->data_mem[A_IN] = vm->data_mem[A_NTIB];
+  vm->running = 0;
 }
 
 /* shifts (logical, cell-width) */
@@ -965,6 +2592,71 @@ static void p_RSHIFT(void){
   dpush((cell)v);
 }
 
+/* superinstructions: emitted by the ; peephole, operand follows inline */
+static void p_LITADD(void){
+  cell n = vm->code_mem[vm->ip++];
+  cell a = dpop();
+  dpush((cell)((ucell)a + (ucell)n));
+}
+static void p_LITAND(void){
+  cell n = vm->code_mem[vm->ip++];
+  cell a = dpop();
+  dpush((cell)(a & n));
+}
+static void p_LITLSHIFT(void){
+  ucell s = (ucell)vm->code_mem[vm->ip++];
+  ucell v = (ucell)dpop();
+  dpush((cell)(s >= (ucell)CELL_BITS ? 0 : (ucell)(v << s)));
+}
+static void p_LITRSHIFT(void){
+  ucell s = (ucell)vm->code_mem[vm->ip++];
+  ucell v = (ucell)dpop();
+  dpush((cell)(s >= (ucell)CELL_BITS ? 0 : (ucell)(v >> s)));
+}
+static void p_LITFETCH(void){
+  cell a = vm->code_mem[vm->ip++];
+  dpush((ucell)a < (ucell)MEM_DATA_CELLS ? vm->data_mem[(ucell)a] : fetch_far(a));
+}
+static void p_LITSTORE(void){
+  cell a = vm->code_mem[vm->ip++];
+  cell v = dpop();
+  if(a < 0 || (ucell)a >= (ucell)MEM_DATA_CELLS){ out_err_i("! bad ", a); vm_exit(1); }
+  vm->data_mem[(ucell)a] = v;
+}
+static void p_DUP0BRANCH(void){
+  if(vm->data_mem[A_STATE] != 0){ p_DUP(); p_0BRANCH(); return; }
+  cell off = vm->code_mem[vm->ip++];
+  if(dpeek() == 0) vm->ip = (ucell)((cell)vm->ip + off);
+}
+static void p_ZEQ0BRANCH(void){
+  if(vm->data_mem[A_STATE] != 0){ p_ZEQ(); p_0BRANCH(); return; }
+  cell off = vm->code_mem[vm->ip++];
+  cell f = dpop();
+  if(f != 0) vm->ip = (ucell)((cell)vm->ip + off);
+}
+static void p_2DUP(void){
+  if(vm->dsp<2){ runtime_recover("data stack underflow"); }
+  dpush(vm->DS[vm->dsp-2]);
+  dpush(vm->DS[vm->dsp-2]);
+}
+/* (TAIL) wi : "W EXIT". A colon word is entered without pushing a return
+   cell, so it returns straight to our caller. */
+static void p_TAIL(void){
+  int wi = (int)vm->code_mem[vm->ip];
+  if(wi >= 0 && wi < vm->dict_n && vm->dict[wi].cfa == XT_DOCOL){
+    vm->current_wi = wi;
+    vm->ip = vm->dict[wi].pfa;
+#if KFORTH_PROFILE
+    if(vm->prof_on) prof_tail(wi);
+#endif
+    return;
+  }
+  /* not a colon word (any more): run it where EXIT would return to */
+  vm->ip = (ucell)rpop();
+  exec_word(wi);
+  if(vm->rsp == vm->rs_base) vm->running = 0;
+}
+
 /* signed /MOD ( a b -- rem quot ) */
 static void p_DIVMOD(void){
   cell b = dpop();
@@ -985,79 +2677,1995 @@ static void p_DIVMOD(void){
   dpush(q);
 }
 
-/* debug */
-static void p_DEPTH(void){ dpush((cell)dsp); }
+#if KFORTH_NATIVE_FLOAT
+/* ===== float32 on a cell (IEEE754 binary32 bits) ===== */
+/*
+  Integer ports of the bootstrap.fth float words, bit for bit: truncating,
+  flush to zero, subnormal inputs rejected, canonical qNaN. Comparisons go
+  through f_lt(), which is bootstrap's "- 0<". Helpers return 0 once they
+  have ABORTed.
+*/
+enum { F_SIGNMASK = (int32_t)0x80000000, F_HIDDEN = 8388608, F_FRACMASK = 8388607,
+       F_OVF_MANT = 16777216, F_NAN = 0x7FC00000 };
 
-static void p_DOTS(void){ /* .S */
-  out_ch('<');
-  out_int(dsp);
-  out_str("> ");
-  for(int i=0;i<dsp;i++){
-    out_int((int)DS[i]);
-    out_ch(' ');
-  }
-}
+static int f_lt(cell a, cell b){ return (cell)((ucell)a - (ucell)b) < 0; }
+static ucell f_sign(ucell f){ return (f >> 31) & 1u; }
+static ucell f_expraw(ucell f){ return (f >> 23) & 255u; }
+static ucell f_frac(ucell f){ return f & (ucell)F_FRACMASK; }
+static ucell f_pack(ucell s, ucell e, ucell frac){ return (s << 31) | (e << 23) | frac; }
+static int f_zero(ucell f){ return (f & 0x7FFFFFFFu) == 0; }
+static int f_inf(ucell f){ return f_expraw(f) == 255u && f_frac(f) == 0; }
+static int f_nan(ucell f){ return f_expraw(f) == 255u && f_frac(f) != 0; }
 
-static void p_WORDS(void){
-  for(int i=latest; i!=-1; i=dict[i].link){
-    out_str(dict[i].name);
-    out_ch(' ');
-  }
-  out_nl();
+static int f_abort(const char *msg){
+  vm_emit('\n');
+  out_str(msg);
+  p_ABORT();
+  return 0;
+}
+static int f_assert_finite(ucell f){
+  if(f_expraw(f) == 255u) return f_abort("float special unsupported");
+  if(f_expraw(f) == 0 && f_frac(f) != 0) return f_abort("float subnormal unsupported");
+  return 1;
+}
+static int f_pack_normal(ucell s, cell e, ucell m, ucell *r){
+  if(!f_lt(0, e)){ *r = 0; return 1; }
+  if(!f_lt(e, 255)) return f_abort("float overflow");
+  *r = f_pack(s, (ucell)e, m & (ucell)F_FRACMASK);
+  return 1;
 }
 
-/* ===== C-side defining words (needed to load bootstrap) ===== */
-
-static void compile_wordtok(int wi){ ccomma(MK_WORDTOK(wi)); }
+typedef struct { ucell s, m; cell e; } fparts;
 
-static int parse_number_c(const char *s, cell *out){
-  char *end=NULL;
-  long v = strtol(s, &end, 0);
-  if(end==s || *end!=0) return 0;
-  if(v < INT32_MIN || v > INT32_MAX) return 0;
-  *out = (cell)v;
+static int f_decode2(ucell a, ucell b, fparts *pa, fparts *pb){
+  if(!f_zero(a) && !f_assert_finite(a)) return 0;
+  if(!f_zero(b) && !f_assert_finite(b)) return 0;
+  pa->s = f_sign(a); pb->s = f_sign(b);
+  pa->e = (cell)f_expraw(a); pb->e = (cell)f_expraw(b);
+  pa->m = pa->e == 0 ? 0 : (f_frac(a) | (ucell)F_HIDDEN);
+  pb->m = pb->e == 0 ? 0 : (f_frac(b) | (ucell)F_HIDDEN);
   return 1;
 }
 
-static void p_COLON(void){
-  char name[128];
-  if(!next_token(name, sizeof(name))){ out_err(": needs name"); return; }
-  int wi = add_word(name, XT_DOCOL, 0);
-  dict[wi].pfa = here_code;
-  compiling = 1;
-  current_def = wi;
-  data_mem[A_STATE] = 1;
+static int f_from_int(cell n, ucell *r){
+  if(n == 0){ *r = 0; return 1; }
+  if(n == (cell)F_SIGNMASK) return f_abort("S>F int32 min unsupported");
+  ucell s = n < 0;
+  ucell a = (ucell)(n < 0 ? -n : n);
+  cell e = 0;
+  for(ucell u = a; u > 1; u >>= 1) e++;
+  ucell m = (e >= 23) ? (a >> (e - 23)) : (a << (23 - e));
+  *r = f_pack(s, (ucell)(e + 127), m & (ucell)F_FRACMASK);
+  return 1;
 }
+static int f_to_int(ucell f, cell *r){
+  if(f_zero(f)){ *r = 0; return 1; }
+  if(!f_assert_finite(f)) return 0;
+  cell e = (cell)f_expraw(f) - 127;
+  if(e < 0){ *r = 0; return 1; }
+  ucell m = f_frac(f) | (ucell)F_HIDDEN;
+  if(f_lt(30, e)) return f_abort("F>S overflow");
+  ucell v = !f_lt(e, 23) ? (m << (e - 23)) : (m >> (23 - e));
+  *r = (cell)(f_sign(f) ? 0u - v : v);
+  return 1;
+}
+static int f_scale2(ucell f, cell k, ucell *r){
+  if(f_zero(f)){ *r = f; return 1; }
+  if(!f_assert_finite(f)) return 0;
+  cell e = (cell)((ucell)f_expraw(f) + (ucell)k);
+  if(!f_lt(0, e)){ *r = 0; return 1; }
+  if(!f_lt(e, 255)) return f_abort("float exponent overflow");
+  *r = f_pack(f_sign(f), (ucell)e, f_frac(f));
+  return 1;
+}
+
+static cell f_eq(ucell a, ucell b){
+  if(f_nan(a) || f_nan(b)) return 0;
+  if(f_zero(a) && f_zero(b)) return -1;
+  return a == b ? -1 : 0;
+}
+/* mixed signs answer with the sign bit (1), as the Forth version does */
+static cell f_less(ucell a, ucell b){
+  if(f_nan(a) || f_nan(b)) return 0;
+  if(f_zero(a) && f_zero(b)) return 0;
+  ucell sa = f_sign(a), sb = f_sign(b);
+  if(sa != sb) return (cell)sa;
+  if(sa == 0) return f_lt((cell)a, (cell)b) ? -1 : 0;
+  return f_lt((cell)b, (cell)a) ? -1 : 0;
+}
+
+static int f_add(ucell a, ucell b, ucell *r){
+  fparts x, y, t;
+  if(f_nan(a) || f_nan(b)){ *r = F_NAN; return 1; }
+  if(f_inf(a) && f_inf(b)){ *r = f_sign(a) != f_sign(b) ? (ucell)F_NAN : a; return 1; }
+  if(f_inf(a)){ *r = a; return 1; }
+  if(f_inf(b)){ *r = b; return 1; }
+  if(!f_decode2(a, b, &x, &y)) return 0;
+  if(x.m == 0){ *r = b; return 1; }
+  if(y.m == 0){ *r = a; return 1; }
+  if(f_lt(x.e, y.e)){ t = x; x = y; y = t; }
+
+  cell d = x.e - y.e;
+  y.m = f_lt(d, 31) ? (y.m >> d) : 0;
+
+  if(x.s == y.s){
+    ucell m = x.m + y.m;
+    cell e = x.e;
+    if(!f_lt((cell)m, F_OVF_MANT)){ m >>= 1; e++; }
+    return f_pack_normal(x.s, e, m, r);
+  }
+  if(x.m == y.m){ *r = 0; return 1; }
+  if(f_lt((cell)x.m, (cell)y.m)){
+    ucell tm = x.m; x.m = y.m; y.m = tm;
+    ucell ts = x.s; x.s = y.s; y.s = ts;
+  }
+  ucell m = x.m - y.m;
+  cell e = x.e;
+  while(f_lt((cell)m, F_HIDDEN) && f_lt(1, e)){ m <<= 1; e--; }
+  if(f_lt((cell)m, F_HIDDEN)){ *r = 0; return 1; }
+  return f_pack_normal(x.s, e, m, r);
+}
+static int f_mul(ucell a, ucell b, ucell *r){
+  fparts x, y;
+  if(f_nan(a) || f_nan(b)){ *r = F_NAN; return 1; }
+  if((f_inf(a) && f_zero(b)) || (f_inf(b) && f_zero(a))){ *r = F_NAN; return 1; }
+  if(f_inf(a) || f_inf(b)){ *r = f_pack(f_sign(a) ^ f_sign(b), 255, 0); return 1; }
+  if(!f_decode2(a, b, &x, &y)) return 0;
+  if(x.m == 0 || y.m == 0){ *r = f_pack(x.s ^ y.s, 0, 0); return 1; }
+
+  cell e = x.e + y.e - 127;
+  uint64_t p = (uint64_t)x.m * (uint64_t)y.m;   /* < 2^48 */
+  ucell m;
+  if(p & ((uint64_t)1 << 47)){ e++; m = (ucell)(p >> 24); }
+  else m = (ucell)(p >> 23);
+  return f_pack_normal(x.s ^ y.s, e, m, r);
+}
+static int f_div(ucell a, ucell b, ucell *r){
+  fparts x, y;
+  ucell s = f_sign(a) ^ f_sign(b);
+  if(f_nan(a) || f_nan(b)){ *r = F_NAN; return 1; }
+  if((f_inf(a) && f_inf(b)) || (f_zero(a) && f_zero(b))){ *r = F_NAN; return 1; }
+  if(f_zero(b) || f_inf(a)){ *r = f_pack(s, 255, 0); return 1; }
+  if(f_inf(b) || f_zero(a)){ *r = f_pack(s, 0, 0); return 1; }
+  if(!f_decode2(a, b, &x, &y)) return 0;
+
+  cell e = x.e - y.e + 127;
+  int k = 23;
+  if(f_lt((cell)x.m, (cell)y.m)){ e--; k = 24; }
+  ucell q = (ucell)(((uint64_t)x.m << k) / y.m);
+  if(f_lt((cell)q, F_HIDDEN)){ *r = 0; return 1; }
+  return f_pack_normal(s, e, q, r);
+}
+
+static void p_STOF(void){
+  ucell r;
+  if(f_from_int(dpop(), &r)) dpush((cell)r);
+}
+static void p_FTOS(void){
+  cell r;
+  if(f_to_int((ucell)dpop(), &r)) dpush(r);
+}
+static void p_FSCALE2(void){
+  cell k = dpop();
+  ucell f = (ucell)dpop();
+  ucell r;
+  if(f_scale2(f, k, &r)) dpush((cell)r);
+}
+static void p_QTOF(void){
+  ucell r;
+  if(f_from_int(dpop(), &r) && f_scale2(r, -16, &r)) dpush((cell)r);
+}
+static void p_FTOQ(void){
+  ucell f;
+  cell r;
+  if(f_scale2((ucell)dpop(), 16, &f) && f_to_int(f, &r)) dpush(r);
+}
+static void p_FEQ(void){ ucell b=(ucell)dpop(), a=(ucell)dpop(); dpush(f_eq(a, b)); }
+static void p_FLT(void){ ucell b=(ucell)dpop(), a=(ucell)dpop(); dpush(f_less(a, b)); }
+static void p_FLE(void){ ucell b=(ucell)dpop(), a=(ucell)dpop(); dpush(f_less(a, b) | f_eq(a, b)); }
+static void p_FADD(void){
+  ucell b=(ucell)dpop(), a=(ucell)dpop(), r;
+  if(f_add(a, b, &r)) dpush((cell)r);
+}
+static void p_FSUB(void){
+  ucell b=(ucell)dpop(), a=(ucell)dpop(), r;
+  if(f_add(a, b ^ 0x80000000u, &r)) dpush((cell)r);
+}
+static void p_FMUL(void){
+  ucell b=(ucell)dpop(), a=(ucell)dpop(), r;
+  if(f_mul(a, b, &r)) dpush((cell)r);
+}
+static void p_FDIV(void){
+  ucell b=(ucell)dpop(), a=(ucell)dpop(), r;
+  if(f_div(a, b, &r)) dpush((cell)r);
+}
+#endif
+
+/* debug */
+static void p_DEPTH(void){ dpush((cell)vm->dsp); }
+
+static void p_DOTS(void){ /* .S */
+  out_ch('<');
+  out_int(vm->dsp);
+  out_str("> ");
+  for(int i=0;i<vm->dsp;i++){
+    out_int((int)vm->DS[i]);
+    out_ch(' ');
+  }
+}
+
+#if !KFORTH_APP
+static void p_WORDS(void){
+  for(int i=vm->latest; i!=-1; i=vm->dict[i].link){
+    out_str(vm->dict[i].name);
+    out_ch(' ');
+  }
+  out_nl();
+}
+#endif
+
+static int xt_is_branch(ucell xt){
+  return xt == XT_BRANCH || xt == XT_0BRANCH || xt == XT_LOOP || xt == XT_PLOOP ||
+         xt == XT_DUP0BRANCH || xt == XT_ZEQ0BRANCH || xt == XT_XQDO || xt == XT_XLEAVE;
+}
+/* primitives followed by one inline operand cell */
+static int xt_has_operand(ucell xt){
+  return xt == XT_LIT || xt_is_branch(xt) ||
+         xt == XT_LITADD || xt == XT_LITAND || xt == XT_LITLSHIFT || xt == XT_LITRSHIFT ||
+         xt == XT_LITFETCH || xt == XT_LITSTORE || xt == XT_TAIL;
+}
+/* primitive behind a code cell, or -1 if the cell is not executable */
+static cell cell_xt(cell instr){
+  if(IS_WORDTOK(instr)){
+    int wi = WORD_ID(instr);
+    return (wi < vm->dict_n) ? (cell)vm->dict[wi].cfa : -1;
+  }
+  return ((ucell)instr < (ucell)prim_n) ? instr : -1;
+}
+
+#if KFORTH_JIT || (KFORTH_SAVE_C && !KFORTH_APP)
+enum { BODY_INSN = 1, BODY_OPND = 2, BODY_TARGET = 4 };
+/*
+  Mark the cells of the body at entry (at most n) reachable from its first
+  cell: instructions, their operands and branch targets. Paths end at EXIT,
+  BRANCH and (DOES>). 0 if a path leaves the range, runs into an operand or
+  meets a cell that is not executable.
+*/
+static int body_reach(ucell entry, ucell n, uint8_t *mark){
+  ucell *work = (ucell *)malloc((n + 1) * sizeof(ucell));
+  int nw = 0, ok = work != NULL;
+  if(ok) work[nw++] = 0;
+  while(ok && nw > 0){
+    ucell a = work[--nw];
+    if(a >= n){ ok = 0; break; }
+    if(mark[a] & BODY_INSN) continue;
+    if(mark[a] & BODY_OPND){ ok = 0; break; }
+    cell xt = cell_xt(vm->code_mem[entry + a]);
+    if(xt < 0){ ok = 0; break; }
+    ucell x = (ucell)xt;
+    ucell len = xt_has_operand(x) ? 2 : 1;
+    mark[a] |= BODY_INSN;
+    if(len == 2){
+      if(a + 1 >= n || (mark[a + 1] & BODY_INSN)){ ok = 0; break; }
+      mark[a + 1] |= BODY_OPND;
+    }
+    if(xt_is_branch(x)){
+      cell t = (cell)(a + 2) + vm->code_mem[entry + a + 1];
+      if(t < 0 || (ucell)t >= n){ ok = 0; break; }
+      mark[t] |= BODY_TARGET;
+      work[nw++] = (ucell)t;
+    }
+    if(x == XT_TAIL){   /* a tail call to itself jumps back to the entry */
+      cell v = vm->code_mem[entry + a + 1];
+      if(v >= 0 && v < vm->dict_n && vm->dict[v].cfa == XT_DOCOL && vm->dict[v].pfa == entry) mark[0] |= BODY_TARGET;
+    }
+    if(x != XT_EXIT && x != XT_BRANCH && x != XT_XDOES && x != XT_TAIL && x != XT_XLEAVE) work[nw++] = a + len;
+  }
+  free(work);
+  return ok;
+}
+#endif
+
+#if !KFORTH_APP
+/* SEE name : decompile a colon definition, one cell per line */
+static void p_SEE(void){
+  int wi = tick_wi();
+  if(wi < 0){ out_err("SEE ?"); return; }
+  Word *w = &vm->dict[wi];
+  if(w->cfa != XT_DOCOL){
+    out_str(w->name);
+    out_str(w->cfa == XT_DOVAR || w->cfa == XT_DODOES ? " created" : " primitive");
+    out_nl();
+    return;
+  }
+
+  ucell end = vm->here_code;
+  for(int i=0;i<vm->dict_n;i++){
+    if(vm->dict[i].cfa == XT_DOCOL && vm->dict[i].pfa > w->pfa && vm->dict[i].pfa < end) end = vm->dict[i].pfa;
+  }
+
+  out_str(": "); out_str(w->name); out_nl();
+  for(ucell a = w->pfa; a < end; ){
+    cell instr = vm->code_mem[a];
+    cell xt = cell_xt(instr);
+    out_uint(a); out_ch(' ');
+    if(IS_WORDTOK(instr) && xt >= 0){
+      out_str(vm->dict[WORD_ID(instr)].name);
+    }else{
+      int k = -1;
+      for(int i=0;i<vm->dict_n && xt >= 0;i++){
+        if(vm->dict[i].cfa == (ucell)xt){ k = i; break; }
+      }
+      if(k >= 0) out_str(vm->dict[k].name);
+      else out_int((int)instr);
+    }
+    a++;
+    if(xt >= 0 && xt_has_operand((ucell)xt) && a < end){
+      cell v = vm->code_mem[a++];
+      out_ch(' ');
+      if(xt_is_branch((ucell)xt)) out_uint((ucell)((cell)a + v));
+      else if((ucell)xt == XT_TAIL && v >= 0 && v < vm->dict_n) out_str(vm->dict[v].name);
+      else out_int((int)v);
+    }
+    out_nl();
+  }
+  out_str(";"); out_nl();
+}
+#endif
+
+#if KFORTH_JIT
+/* ===== x86-64 JIT: hot colon bodies to native code ===== */
+/*
+  A body is translated cell by cell into code that keeps the VM state
+  exactly as the interpreter would: DS and RS in vm memory, return
+  addresses as code cells. Simple primitives are open-coded, calls to
+  compiled words are native calls, and every other cell calls its p_*
+  through prim_table. When a guard fails (stack depth, bad address, STATE
+  set) or a call leaves ip anywhere but the next cell, the code stores ip
+  and returns, and the interpreter resumes from that cell, so errors and
+  odd control flow behave as before.
+  Registers: rbx = vm, r12 = DS, r13d = dsp (stored back before calls).
+  CODE! or ,C into a compiled range, and (DOES>) on a word that native code
+  depends on, discard the affected code.
+*/
+#include <stddef.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define VOFF(f) ((uint32_t)offsetof(kf_vm, f))
+enum { CC_B = 2, CC_AE = 3, CC_E = 4, CC_NE = 5, CC_L = 0xC, CC_G = 0xF };
+enum { JL_LEAVE = -1 };           /* labels: >= 0 cell, -1 leave, <= -2 stub */
+
+typedef struct JitCtx {
+  uint8_t *buf;
+  uint32_t n, cap;
+  int      fail;
+  ucell    entry, ncell;
+  uint32_t uid;
+  int32_t *pos;                   /* native offset of each cell */
+  int32_t *bail;                  /* stub resuming at each cell, or 0 */
+  uint8_t *mark;
+  struct { uint32_t at; int32_t to; } *fix;
+  int      nfix, maxfix;
+  struct { ucell ip; int32_t pos; } *stub;
+  int      nstub, maxstub;
+  int32_t  leave;
+} JitCtx;
+
+static void jb(JitCtx *j, unsigned b){
+  if(j->n < j->cap) j->buf[j->n++] = (uint8_t)b;
+  else j->fail = 1;
+}
+static void jd(JitCtx *j, uint32_t d){ jb(j, d & 255u); jb(j, (d >> 8) & 255u); jb(j, (d >> 16) & 255u); jb(j, d >> 24); }
+static void jq(JitCtx *j, uint64_t q){ jd(j, (uint32_t)q); jd(j, (uint32_t)(q >> 32)); }
+
+static void jrel(JitCtx *j, int32_t to){
+  if(j->nfix >= j->maxfix){ j->fail = 1; return; }
+  j->fix[j->nfix].at = j->n;
+  j->fix[j->nfix].to = to;
+  j->nfix++;
+  jd(j, 0);
+}
+static void jjcc(JitCtx *j, unsigned cc, int32_t to){ jb(j, 0x0F); jb(j, 0x80 | cc); jrel(j, to); }
+static void jjmp(JitCtx *j, int32_t to){ jb(j, 0xE9); jrel(j, to); }
+
+static int32_t jstub(JitCtx *j, ucell ip){
+  if(j->nstub >= j->maxstub){ j->fail = 1; return JL_LEAVE; }
+  j->stub[j->nstub].ip = ip;
+  return -2 - j->nstub++;
+}
+/* label that resumes the interpreter at cell a */
+static int32_t jbail(JitCtx *j, ucell a){
+  if(!j->bail[a]) j->bail[a] = jstub(j, j->entry + a);
+  return j->bail[a];
+}
+
+/* op reg,[rbx+off] / [rbx+rdx*4+off] / [rbx+rax*4+off] / [r12+r13*4+d8] */
+static void j_vm(JitCtx *j, unsigned op, unsigned reg, uint32_t off){ jb(j, op); jb(j, 0x83 | (reg << 3)); jd(j, off); }
+static void j_rs(JitCtx *j, unsigned op, unsigned reg, uint32_t off){ jb(j, op); jb(j, 0x84 | (reg << 3)); jb(j, 0x93); jd(j, off); }
+static void j_mem(JitCtx *j, unsigned op, unsigned reg, uint32_t off){ jb(j, op); jb(j, 0x84 | (reg << 3)); jb(j, 0x83); jd(j, off); }
+static void j_ds(JitCtx *j, unsigned op, unsigned reg, int d8){ jb(j, 0x43); jb(j, op); jb(j, 0x44 | (reg << 3)); jb(j, 0xAC); jb(j, (uint8_t)d8); }
+static void j_dsp_add(JitCtx *j, int k){
+  jb(j, 0x41);
+  if(k == 1){ jb(j, 0xFF); jb(j, 0xC5); }
+  else if(k == -1){ jb(j, 0xFF); jb(j, 0xCD); }
+  else if(k > 0){ jb(j, 0x83); jb(j, 0xC5); jb(j, (unsigned)k); }
+  else{ jb(j, 0x83); jb(j, 0xED); jb(j, (unsigned)-k); }
+}
+static void j_dsp_store(JitCtx *j){ jb(j, 0x44); j_vm(j, 0x89, 5, VOFF(dsp)); }
+static void j_dsp_load(JitCtx *j){ jb(j, 0x44); j_vm(j, 0x8B, 5, VOFF(dsp)); }
+static void j_set(JitCtx *j, uint32_t off, uint32_t v){ j_vm(j, 0xC7, 0, off); jd(j, v); }
+static void j_push_eax(JitCtx *j){ j_ds(j, 0x89, 0, 0); j_dsp_add(j, 1); }
+
+/* bail at cell a unless need <= dsp <= DS_DEPTH-room (likewise for RS) */
+static void g_ds(JitCtx *j, ucell a, int need, int room){
+  if(need){ jb(j, 0x41); jb(j, 0x83); jb(j, 0xFD); jb(j, (unsigned)need); jjcc(j, CC_L, jbail(j, a)); }
+  if(room){ jb(j, 0x41); jb(j, 0x81); jb(j, 0xFD); jd(j, (uint32_t)(DS_DEPTH - room)); jjcc(j, CC_G, jbail(j, a)); }
+}
+static void g_rs(JitCtx *j, ucell a, int need, int room){
+  if(need){ j_vm(j, 0x83, 7, VOFF(rsp)); jb(j, (unsigned)need); jjcc(j, CC_L, jbail(j, a)); }
+  if(room){ j_vm(j, 0x81, 7, VOFF(rsp)); jd(j, (uint32_t)(RS_DEPTH - room)); jjcc(j, CC_G, jbail(j, a)); }
+}
+/* branch and loop words compile themselves while STATE is set */
+static void g_state(JitCtx *j, ucell a){
+  j_vm(j, 0x83, 7, VOFF(data_mem) + (uint32_t)A_STATE * 4u); jb(j, 0);
+  jjcc(j, CC_NE, jbail(j, a));
+}
+
+/* after a call: reload dsp, leave if the thread stopped or this code died */
+static void j_after_call(JitCtx *j){
+  j_dsp_load(j);
+  j_vm(j, 0x83, 7, VOFF(running)); jb(j, 0);
+  jjcc(j, CC_E, JL_LEAVE);
+  j_vm(j, 0x80, 7, VOFF(jit_dead) + j->uid); jb(j, 0);
+  jjcc(j, CC_NE, JL_LEAVE);
+}
+
+/* any primitive: ip as the interpreter would have it, then check where it went */
+static void j_prim(JitCtx *j, ucell a, cell instr, ucell xt){
+  ucell ip = j->entry + a;
+  ucell next = ip + (xt_has_operand(xt) ? 2u : 1u);
+  j_set(j, VOFF(ip), ip + 1);
+  if(IS_WORDTOK(instr)){
+    j_set(j, VOFF(current_wi), (uint32_t)WORD_ID(instr));
+    vm->jit_dep[WORD_ID(instr)] = 1;
+  }
+  j_dsp_store(j);
+  jb(j, 0x48); jb(j, 0xB8); jq(j, (uint64_t)(uintptr_t)prim_table[xt]);   /* mov rax, fn */
+  jb(j, 0xFF); jb(j, 0xD0);                                               /* call rax */
+  j_after_call(j);
+  if(xt == XT_XDOES){ jjmp(j, JL_LEAVE); return; }   /* returned to the caller */
+  if(xt_is_branch(xt)){
+    ucell t = (ucell)((cell)(a + 2) + vm->code_mem[ip + 1]);
+    j_vm(j, 0x81, 7, VOFF(ip)); jd(j, j->entry + t);
+    jjcc(j, CC_E, (int32_t)t);
+  }
+  j_vm(j, 0x81, 7, VOFF(ip)); jd(j, next);
+  jjcc(j, CC_NE, JL_LEAVE);
+}
+
+/* colon or DOES> word: push the return cell, then its native body or the interpreter */
+static void j_call_word(JitCtx *j, ucell a, int wi){
+  Word *w = &vm->dict[wi];
+  int does = (w->cfa == XT_DODOES);
+  ucell ret = j->entry + a + 1;
+  g_ds(j, a, 0, does);
+  g_rs(j, a, 0, 1);
+  if(does){
+    j_ds(j, 0xC7, 0, 0); jd(j, w->pfa);
+    j_dsp_add(j, 1);
+    vm->jit_dep[wi] = 1;
+  }
+  j_vm(j, 0x8B, 2, VOFF(rsp));                       /* mov edx,[rsp] */
+  j_rs(j, 0xC7, 0, VOFF(RS)); jd(j, ret);            /* RS[edx] = ret */
+  jb(j, 0xFF); jb(j, 0xC2);                          /* inc edx */
+  j_vm(j, 0x89, 2, VOFF(rsp));
+  jb(j, 0x48); j_vm(j, 0x8B, 0, VOFF(jit_fn) + (uint32_t)wi * 8u);   /* mov rax, jit_fn[wi] */
+  jb(j, 0x48); jb(j, 0x85); jb(j, 0xC0);                             /* test rax,rax */
+  jjcc(j, CC_E, jstub(j, does ? w->does_ip : w->pfa));
+  j_dsp_store(j);
+  jb(j, 0x48); jb(j, 0x89); jb(j, 0xDF);             /* mov rdi, rbx */
+  jb(j, 0xFF); jb(j, 0xD0);                          /* call rax */
+  j_after_call(j);
+  j_vm(j, 0x81, 7, VOFF(ip)); jd(j, ret);
+  jjcc(j, CC_NE, JL_LEAVE);
+}
+
+static void j_cell(JitCtx *j, ucell a){
+  ucell ip = j->entry + a;
+  cell instr = vm->code_mem[ip];
+  ucell x = (ucell)cell_xt(instr);
+  cell v = xt_has_operand(x) ? vm->code_mem[ip + 1] : 0;
+  int32_t t = xt_is_branch(x) ? (int32_t)((cell)(a + 2) + v) : 0;
+  uint32_t data = VOFF(data_mem);
+
+  if(IS_WORDTOK(instr) && (x == XT_DOCOL || x == XT_DODOES)){
+    j_call_word(j, a, WORD_ID(instr));
+  }else if(IS_WORDTOK(instr) && x == XT_DOVAR){
+    g_ds(j, a, 0, 1);
+    j_ds(j, 0xC7, 0, 0); jd(j, vm->dict[WORD_ID(instr)].pfa);
+    j_dsp_add(j, 1);
+    vm->jit_dep[WORD_ID(instr)] = 1;
+  }else if(x == XT_EXIT){
+    g_rs(j, a, 1, 0);
+    j_vm(j, 0x8B, 2, VOFF(rsp));
+    jb(j, 0xFF); jb(j, 0xCA);                        /* dec edx */
+    j_rs(j, 0x8B, 0, VOFF(RS));
+    j_vm(j, 0x89, 2, VOFF(rsp));
+    j_vm(j, 0x89, 0, VOFF(ip));
+    j_vm(j, 0x3B, 2, VOFF(rs_base));
+    jjcc(j, CC_NE, JL_LEAVE);
+    j_set(j, VOFF(running), 0);
+    jjmp(j, JL_LEAVE);
+  }else if(x == XT_TAIL && v >= 0 && v < vm->dict_n && vm->dict[v].cfa == XT_DOCOL && vm->dict[v].pfa == j->entry){
+    vm->jit_dep[v] = 1;
+    jjmp(j, 0);                                      /* tail call to itself */
+  }else if(x == XT_LIT){
+    g_ds(j, a, 0, 1);
+    j_ds(j, 0xC7, 0, 0); jd(j, (uint32_t)v);
+    j_dsp_add(j, 1);
+  }else if(x == XT_DUP){
+    g_ds(j, a, 1, 1);
+    j_ds(j, 0x8B, 0, -4); j_push_eax(j);
+  }else if(x == XT_DROP){
+    g_ds(j, a, 1, 0);
+    j_dsp_add(j, -1);
+  }else if(x == XT_SWAP){
+    g_ds(j, a, 2, 0);
+    j_ds(j, 0x8B, 0, -4); j_ds(j, 0x8B, 1, -8);
+    j_ds(j, 0x89, 1, -4); j_ds(j, 0x89, 0, -8);
+  }else if(x == XT_OVER){
+    g_ds(j, a, 2, 1);
+    j_ds(j, 0x8B, 0, -8); j_push_eax(j);
+  }else if(x == XT_2DUP){
+    g_ds(j, a, 2, 2);
+    j_ds(j, 0x8B, 0, -8); j_ds(j, 0x8B, 1, -4);
+    j_ds(j, 0x89, 0, 0); j_ds(j, 0x89, 1, 4);
+    j_dsp_add(j, 2);
+  }else if(x == XT_ADD || x == XT_SUB || x == XT_AND || x == XT_OR || x == XT_XOR){
+    g_ds(j, a, 2, 0);
+    j_ds(j, 0x8B, 0, -4);
+    j_ds(j, x == XT_ADD ? 0x01 : x == XT_SUB ? 0x29 : x == XT_AND ? 0x21 : x == XT_OR ? 0x09 : 0x31, 0, -8);
+    j_dsp_add(j, -1);
+  }else if(x == XT_ZEQ){
+    g_ds(j, a, 1, 0);
+    j_ds(j, 0x83, 7, -4); jb(j, 0);                  /* cmp T,0 */
+    jb(j, 0x0F); jb(j, 0x94); jb(j, 0xC0);           /* sete al */
+    jb(j, 0x0F); jb(j, 0xB6); jb(j, 0xC0);           /* movzx eax,al */
+    jb(j, 0xF7); jb(j, 0xD8);                        /* neg eax */
+    j_ds(j, 0x89, 0, -4);
+  }else if(x == XT_0LT){
+    g_ds(j, a, 1, 0);
+    j_ds(j, 0x8B, 0, -4);
+    jb(j, 0xC1); jb(j, 0xF8); jb(j, 31);             /* sar eax,31 */
+    j_ds(j, 0x89, 0, -4);
+  }else if(x == XT_FETCH || x == XT_STORE){
+    g_ds(j, a, x == XT_FETCH ? 1 : 2, 0);
+    j_ds(j, 0x8B, 0, -4);
+    jb(j, 0x3D); jd(j, MEM_DATA_CELLS);              /* cmp eax,MEM_DATA_CELLS */
+    jjcc(j, CC_AE, jbail(j, a));
+    if(x == XT_FETCH){
+      j_mem(j, 0x8B, 0, data);
+      j_ds(j, 0x89, 0, -4);
+    }else{
+      j_ds(j, 0x8B, 1, -8);
+      j_mem(j, 0x89, 1, data);
+      j_dsp_add(j, -2);
+    }
+  }else if(x == XT_LITADD || x == XT_LITAND){
+    g_ds(j, a, 1, 0);
+    j_ds(j, 0x81, x == XT_LITADD ? 0 : 4, -4); jd(j, (uint32_t)v);
+  }else if(x == XT_LITLSHIFT || x == XT_LITRSHIFT){
+    g_ds(j, a, 1, 0);
+    if((ucell)v >= (ucell)CELL_BITS){ j_ds(j, 0xC7, 0, -4); jd(j, 0); }
+    else{ j_ds(j, 0xC1, x == XT_LITLSHIFT ? 4 : 5, -4); jb(j, (unsigned)v); }
+  }else if(x == XT_LITFETCH || x == XT_LITSTORE){
+    if(v < 0 || (ucell)v >= (ucell)MEM_DATA_CELLS){ jjmp(j, jbail(j, a)); return; }
+    if(x == XT_LITFETCH){
+      g_ds(j, a, 0, 1);
+      j_vm(j, 0x8B, 0, data + (uint32_t)v * 4u);
+      j_push_eax(j);
+    }else{
+      g_ds(j, a, 1, 0);
+      j_ds(j, 0x8B, 0, -4);
+      j_vm(j, 0x89, 0, data + (uint32_t)v * 4u);
+      j_dsp_add(j, -1);
+    }
+  }else if(x == XT_BRANCH){
+    g_state(j, a);
+    jjmp(j, t);
+  }else if(x == XT_0BRANCH || x == XT_ZEQ0BRANCH){
+    g_state(j, a);
+    g_ds(j, a, 1, 0);
+    j_dsp_add(j, -1);
+    j_ds(j, 0x8B, 0, 0);
+    jb(j, 0x85); jb(j, 0xC0);                        /* test eax,eax */
+    jjcc(j, x == XT_0BRANCH ? CC_E : CC_NE, t);
+  }else if(x == XT_DUP0BRANCH){
+    g_state(j, a);
+    g_ds(j, a, 1, 0);
+    j_ds(j, 0x83, 7, -4); jb(j, 0);
+    jjcc(j, CC_E, t);
+  }else if(x == XT_DO){
+    g_state(j, a);
+    g_ds(j, a, 2, 0);
+    g_rs(j, a, 0, 2);
+    j_ds(j, 0x8B, 0, -4); j_ds(j, 0x8B, 1, -8);      /* index, limit */
+    j_dsp_add(j, -2);
+    j_vm(j, 0x8B, 2, VOFF(rsp));
+    j_rs(j, 0x89, 1, VOFF(RS));
+    j_rs(j, 0x89, 0, VOFF(RS) + 4u);
+    jb(j, 0x83); jb(j, 0xC2); jb(j, 2);              /* add edx,2 */
+    j_vm(j, 0x89, 2, VOFF(rsp));
+  }else if(x == XT_LOOP){
+    g_state(j, a);
+    g_rs(j, a, 2, 0);
+    j_vm(j, 0x8B, 2, VOFF(rsp));
+    j_rs(j, 0x8B, 0, VOFF(RS) - 4u);
+    jb(j, 0xFF); jb(j, 0xC0);                        /* inc eax */
+    j_rs(j, 0x3B, 0, VOFF(RS) - 8u);
+    jb(j, 0x74); jb(j, 12);                          /* je done */
+    j_rs(j, 0x89, 0, VOFF(RS) - 4u);                 /* 7 bytes */
+    jjmp(j, t);                                      /* 5 bytes */
+    jb(j, 0x83); jb(j, 0xEA); jb(j, 2);              /* done: sub edx,2 */
+    j_vm(j, 0x89, 2, VOFF(rsp));
+  }else if(x == XT_I || x == XT_RAT){
+    g_rs(j, a, x == XT_I ? 2 : 1, 0);
+    g_ds(j, a, 0, 1);
+    j_vm(j, 0x8B, 2, VOFF(rsp));
+    j_rs(j, 0x8B, 0, VOFF(RS) - 4u);
+    j_push_eax(j);
+  }else if(x == XT_IADD || x == XT_IADDFETCH){
+    g_rs(j, a, 2, 0);
+    g_ds(j, a, 1, 0);
+    j_vm(j, 0x8B, 2, VOFF(rsp));
+    j_rs(j, 0x8B, 0, VOFF(RS) - 4u);
+    j_ds(j, 0x03, 0, -4);                            /* add eax,T */
+    if(x == XT_IADDFETCH){
+      jb(j, 0x3D); jd(j, MEM_DATA_CELLS);
+      jjcc(j, CC_AE, jbail(j, a));
+      j_mem(j, 0x8B, 0, data);
+    }
+    j_ds(j, 0x89, 0, -4);
+  }else if(x == XT_TOR){
+    g_ds(j, a, 1, 0);
+    g_rs(j, a, 0, 1);
+    j_ds(j, 0x8B, 0, -4);
+    j_dsp_add(j, -1);
+    j_vm(j, 0x8B, 2, VOFF(rsp));
+    j_rs(j, 0x89, 0, VOFF(RS));
+    jb(j, 0xFF); jb(j, 0xC2);
+    j_vm(j, 0x89, 2, VOFF(rsp));
+  }else if(x == XT_RFROM){
+    g_rs(j, a, 1, 0);
+    g_ds(j, a, 0, 1);
+    j_vm(j, 0x8B, 2, VOFF(rsp));
+    jb(j, 0xFF); jb(j, 0xCA);
+    j_rs(j, 0x8B, 0, VOFF(RS));
+    j_vm(j, 0x89, 2, VOFF(rsp));
+    j_push_eax(j);
+  }else{
+    j_prim(j, a, instr, x);
+  }
+}
+
+/* copy finished code into the arena (kept W^X); NULL when full */
+static jit_entry jit_install(const uint8_t *code, size_t n){
+  static size_t page;
+  if(!page) page = (size_t)sysconf(_SC_PAGESIZE);
+  if(!vm->jit_mem){
+    void *m = mmap(NULL, JIT_ARENA, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(m == MAP_FAILED) return NULL;
+    vm->jit_mem = (uint8_t *)m;
+  }
+  size_t at = (vm->jit_used + 15u) & ~(size_t)15u;
+  if(at + n > JIT_ARENA) return NULL;
+  uint8_t *lo = vm->jit_mem + (at & ~(page - 1));
+  size_t span = (size_t)(vm->jit_mem + at + n - lo);
+  if(mprotect(lo, span, PROT_READ | PROT_WRITE) != 0) return NULL;
+  memcpy(vm->jit_mem + at, code, n);
+  if(mprotect(lo, span, PROT_READ | PROT_EXEC) != 0) return NULL;
+  vm->jit_used = at + n;
+  return (jit_entry)(void *)(vm->jit_mem + at);
+}
+
+static jit_entry jit_build(ucell entry){
+  if(vm->jit_units >= JIT_UNITS || entry >= vm->here_code) return NULL;
+  JitCtx jc, *j = &jc;
+  memset(j, 0, sizeof(*j));
+  j->entry = entry;
+  j->ncell = vm->here_code - entry;
+  if(j->ncell > JIT_MAX_CELLS) j->ncell = JIT_MAX_CELLS;
+  j->uid = (uint32_t)vm->jit_units;
+  j->cap = j->ncell * 160u + 256u;
+  j->maxfix = (int)j->ncell * 10 + 8;
+  j->maxstub = (int)j->ncell * 2 + 8;
+  j->buf = (uint8_t *)malloc(j->cap);
+  j->pos = (int32_t *)malloc(j->ncell * sizeof(int32_t));
+  j->bail = (int32_t *)calloc(j->ncell, sizeof(int32_t));
+  j->mark = (uint8_t *)calloc(j->ncell, 1);
+  j->fix = malloc((size_t)j->maxfix * sizeof(*j->fix));
+  j->stub = malloc((size_t)j->maxstub * sizeof(*j->stub));
+  jit_entry code = NULL;
+  if(!j->buf || !j->pos || !j->bail || !j->mark || !j->fix || !j->stub ||
+     !body_reach(entry, j->ncell, j->mark)) goto done;
+
+  static const uint8_t prologue[] = {
+    0x53, 0x41, 0x54, 0x41, 0x55,        /* push rbx, r12, r13 */
+    0x48, 0x89, 0xFB                     /* mov rbx, rdi */
+  };
+  for(size_t k=0;k<sizeof(prologue);k++) jb(j, prologue[k]);
+  jb(j, 0x4C); j_vm(j, 0x8B, 4, VOFF(DS));   /* mov r12,[vm->DS] */
+  j_dsp_load(j);
+  ucell lo = j->ncell, hi = 0;
+  for(ucell a=0; a<j->ncell; a++){
+    j->pos[a] = -1;
+    if(!(j->mark[a] & BODY_INSN)) continue;
+    j->pos[a] = (int32_t)j->n;
+    j_cell(j, a);
+    if(a < lo) lo = a;
+    hi = a + (xt_has_operand((ucell)cell_xt(vm->code_mem[entry + a])) ? 2 : 1);
+  }
+  j->leave = (int32_t)j->n;
+  j_dsp_store(j);
+  jb(j, 0x41); jb(j, 0x5D); jb(j, 0x41); jb(j, 0x5C); jb(j, 0x5B); jb(j, 0xC3);   /* pop r13,r12,rbx; ret */
+  for(int k=0;k<j->nstub;k++){
+    j->stub[k].pos = (int32_t)j->n;
+    j_set(j, VOFF(ip), j->stub[k].ip);
+    jjmp(j, JL_LEAVE);
+  }
+  if(j->fail) goto done;
+  for(int k=0;k<j->nfix;k++){
+    int32_t to = j->fix[k].to, dst;
+    if(to == JL_LEAVE) dst = j->leave;
+    else if(to <= -2) dst = j->stub[-2 - to].pos;
+    else if((ucell)to < j->ncell && j->pos[to] >= 0) dst = j->pos[to];
+    else goto done;
+    uint32_t rel = (uint32_t)(dst - (int32_t)(j->fix[k].at + 4));
+    memcpy(j->buf + j->fix[k].at, &rel, 4);
+  }
+  code = jit_install(j->buf, j->n);
+  if(code){
+    JitUnit *u = &vm->jit_unit[vm->jit_units++];
+    u->entry = entry;
+    u->lo = entry + lo;
+    u->hi = entry + hi;
+    u->code = code;
+    vm->jit_dead[j->uid] = 0;
+    if(vm->jit_lo == vm->jit_hi){ vm->jit_lo = u->lo; vm->jit_hi = u->hi; }
+    if(u->lo < vm->jit_lo) vm->jit_lo = u->lo;
+    if(u->hi > vm->jit_hi) vm->jit_hi = u->hi;
+  }
+done:
+  free(j->buf); free(j->pos); free(j->bail); free(j->mark); free(j->fix); free(j->stub);
+  return code;
+}
+
+/* native body of wi, compiling it on its KFORTH_JIT_HOT-th call */
+static jit_entry jit_lookup(int wi){
+  if(!vm->jit_on) return NULL;
+#if KFORTH_PROFILE
+  if(vm->prof_on) return NULL;
+#endif
+  jit_entry f = vm->jit_fn[wi];
+  if(f || vm->jit_hits[wi] >= KFORTH_JIT_HOT || ++vm->jit_hits[wi] < KFORTH_JIT_HOT) return f;
+  Word *w = &vm->dict[wi];
+  ucell entry;
+  if(w->cfa == XT_DOCOL) entry = w->pfa;
+  else if(w->cfa == XT_DODOES) entry = w->does_ip;
+  else return NULL;
+  for(int u=0;u<vm->jit_units;u++){
+    if(!vm->jit_dead[u] && vm->jit_unit[u].entry == entry) return vm->jit_fn[wi] = vm->jit_unit[u].code;
+  }
+  return vm->jit_fn[wi] = jit_build(entry);
+}
+
+static void jit_forget(int u){
+  vm->jit_dead[u] = 1;
+  for(int i=0;i<vm->dict_n;i++){
+    if(vm->jit_fn[i] == vm->jit_unit[u].code){ vm->jit_fn[i] = NULL; vm->jit_hits[i] = 0; }
+  }
+}
+
+/* drop all native code; the arena is reused once no native frame is live */
+static void jit_flush(void){
+  for(int u=0;u<vm->jit_units;u++) vm->jit_dead[u] = 1;
+  memset(vm->jit_fn, 0, sizeof(vm->jit_fn));
+  memset(vm->jit_hits, 0, sizeof(vm->jit_hits));
+  memset(vm->jit_dep, 0, sizeof(vm->jit_dep));
+  vm->jit_lo = vm->jit_hi = 0;
+  if(!vm->jit_active){ vm->jit_units = 0; vm->jit_used = 0; }
+}
+
+/* code cell a is about to change */
+static void jit_invalidate(ucell a){
+  if(a < vm->jit_lo || a >= vm->jit_hi) return;
+  for(int u=0;u<vm->jit_units;u++){
+    if(!vm->jit_dead[u] && a >= vm->jit_unit[u].lo && a < vm->jit_unit[u].hi) jit_forget(u);
+  }
+}
+
+static void p_JITON(void){ vm->jit_on = 1; }
+static void p_JITOFF(void){ vm->jit_on = 0; }
+#undef VOFF
+#endif
+
+/* ===== direct-threaded inner interpreter ===== */
+#if KFORTH_DIRECT_THREADED
+/*
+  Computed-goto variant of run_thread(). A word token resolves through its
+  cfa straight to a label, so one dispatch is a single indirect jump.
+  DOCOL/DOVAR/DODOES enter the word body inline and the hot primitives are
+  open-coded with the same checks and messages as their p_* versions; every
+  other primitive is called through prim_table with ip written back.
+
+  With KFORTH_TOS_CACHE the top data-stack cell lives in a local (T) for the
+  whole loop and DS[dsp-1] is stale; it is spilled around anything that
+  looks at DS in memory. DS[-1] is a scratch cell so push/pop never branch
+  on an empty stack.
+*/
+/*
+  The innermost DO loop's index and limit live in locals (li, ll) while lc
+  is set; LOOP refills them from RS after a spill. They are pushed back to
+  RS before anything else looks at it: nested DO, calls, EXIT, >R R> R@ and
+  every primitive called through prim_table.
+*/
+#define LSPILL() do{ if(lc){ lc = 0; rpush(ll); rpush(li); } }while(0)
+#define LFILL()  do{ if(!lc){ \
+    if(vm->rsp < 2) runtime_recover("return stack underflow"); \
+    li = vm->RS[vm->rsp-1]; ll = vm->RS[vm->rsp-2]; vm->rsp -= 2; lc = 1; } }while(0)
+
+#if KFORTH_TOS_CACHE
+#define T        tos
+#define SPILL()  (vm->DS[vm->dsp-1] = tos)
+#define FILL()   (tos = vm->DS[vm->dsp-1])
+#else
+#define T        vm->DS[vm->dsp-1]
+#define SPILL()  ((void)0)
+#define FILL()   ((void)0)
+#endif
+#define NOS      vm->DS[vm->dsp-2]
+#define NEED(n)  do{ if(vm->dsp < (n)) runtime_recover("data stack underflow"); }while(0)
+#define PUSH(x)  do{ cell x_ = (x); if(vm->dsp >= DS_DEPTH) runtime_recover("data stack overflow"); \
+                     SPILL(); vm->dsp++; T = x_; }while(0)
+#define DROP1()  do{ vm->dsp--; FILL(); }while(0)
+
+static kf_vm *vm_self(void){ return vm; }
+static int engine_setup_only = 0;   /* run_thread() just fills its tables */
+
+static void run_thread(void){
+  static const prim_fn inl_fn[] = {
+    p_EXIT, p_LIT, p_BRANCH, p_0BRANCH, p_DOCOL, p_DOVAR, p_DODOES,
+    p_DROP, p_DUP, p_SWAP, p_OVER, p_ADD, p_SUB, p_AND, p_OR, p_XOR,
+    p_ZEQ, p_0LT, p_FETCH, p_STORE, p_CAT, p_CSTORE, p_TOR, p_RFROM, p_RAT,
+    p_DO, p_LOOP, p_PLOOP, p_I,
+    p_LITADD, p_LITAND, p_LITLSHIFT, p_LITRSHIFT, p_LITFETCH, p_LITSTORE,
+    p_DUP0BRANCH, p_ZEQ0BRANCH, p_2DUP, p_TAIL,
+    p_XQDO, p_XLEAVE, p_IADD, p_IADDFETCH
+  };
+  static void * const inl_op[] = {
+    &&op_exit, &&op_lit, &&op_branch, &&op_0branch, &&op_docol, &&op_dovar, &&op_dodoes,
+    &&op_drop, &&op_dup, &&op_swap, &&op_over, &&op_add, &&op_sub, &&op_and, &&op_or, &&op_xor,
+    &&op_zeq, &&op_0lt, &&op_fetch, &&op_store, &&op_cat, &&op_cstore, &&op_tor, &&op_rfrom, &&op_rat,
+    &&op_do, &&op_loop, &&op_ploop, &&op_i,
+    &&op_litadd, &&op_litand, &&op_litlshift, &&op_litrshift, &&op_litfetch, &&op_litstore,
+    &&op_dup0branch, &&op_zeq0branch, &&op_2dup, &&op_tail,
+    &&op_xqdo, &&op_xleave, &&op_iadd, &&op_iaddfetch
+  };
+  static void *disp[PRIM_MAX + 1];
+  static int disp_n = -1;
+
+  if(disp_n != prim_n){
+    for(int i=0;i<=PRIM_MAX;i++) disp[i] = &&op_call;
+    for(int i=0;i<prim_n;i++){
+      for(size_t k=0;k<sizeof(inl_fn)/sizeof(inl_fn[0]);k++){
+        if(prim_table[i] == inl_fn[k]){ disp[i] = inl_op[k]; break; }
+      }
+    }
+    disp_n = prim_n;
+  }
+  if(engine_setup_only) return;
+
+  kf_vm * const vm = vm_self();   /* keep the (thread-local) VM pointer in a register */
+  Word *w;
+  cell instr, a, v, off;
+  ucell xt;
+  ucell lip = vm->ip;
+  cell li = 0, ll = 0;   /* cached loop index and limit, valid while lc */
+  int lc = 0;
+#if KFORTH_TOS_CACHE
+  cell tos = vm->DS[vm->dsp-1];
+#endif
+#if KFORTH_JIT
+  jit_entry jf;
+#endif
+#if KFORTH_APP
+  app_fn af;
+#endif
+  vm->running = 1;
+
+next:
+  instr = vm->code_mem[lip++];
+#if KFORTH_COUNT_CELLS
+  vm->cells_run++;
+#endif
+  if(IS_WORDTOK(instr)){
+    int wi = WORD_ID(instr);
+    if(wi >= vm->dict_n){ out_err_i("bad wi ", wi); vm_exit(1); }
+    w = &vm->dict[wi];
+    xt = w->cfa;
+  }else{
+    w = NULL;
+    xt = (ucell)instr;
+  }
+#if KFORTH_PROFILE
+  if(vm->prof_on) prof_cell(w ? (int)(w - vm->dict) : xt < (ucell)prim_n ? prim_wi[xt] : -1);
+#endif
+  goto *disp[xt < (ucell)PRIM_MAX ? xt : (ucell)PRIM_MAX];
+
+op_call:
+  if(xt >= (ucell)prim_n){ out_err_u("bad xt ", (unsigned)xt); vm_exit(1); }
+  if(w) vm->current_wi = (int)(w - vm->dict);
+  LSPILL();
+  vm->ip = lip;
+  SPILL();
+  prim_table[xt]();
+  if(!vm->running) return;
+  FILL();
+  lip = vm->ip;
+  goto next;
+
+op_exit:
+  LSPILL();
+  lip = (ucell)rpop();
+  if(vm->rsp == vm->rs_base){ SPILL(); vm->ip = lip; vm->running = 0; return; }
+  goto next;
+op_lit:
+  PUSH(vm->code_mem[lip++]);
+  goto next;
+op_branch:
+  if(vm->data_mem[A_STATE] != 0) goto op_call;
+  off = vm->code_mem[lip++];
+  lip = (ucell)((cell)lip + off);
+  goto next;
+op_0branch:
+  if(vm->data_mem[A_STATE] != 0) goto op_call;
+  off = vm->code_mem[lip++];
+  NEED(1);
+  a = T; DROP1();
+  if(a == 0) lip = (ucell)((cell)lip + off);
+  goto next;
+
+op_docol:
+  if(!w) goto op_call;
+  LSPILL();
+  rpush((cell)lip);
+  lip = w->pfa;
+#if KFORTH_PROFILE
+  if(vm->prof_on) prof_enter((int)(w - vm->dict));
+#endif
+#if KFORTH_JIT
+  if((jf = jit_lookup((int)(w - vm->dict))) != NULL) goto op_native;
+#endif
+#if KFORTH_APP
+  if((af = app_word((int)(w - vm->dict))) != NULL) goto op_app;
+#endif
+  goto next;
+op_dovar:
+  if(!w) goto op_call;
+  PUSH((cell)w->pfa);
+  goto next;
+op_dodoes:
+  if(!w) goto op_call;
+  PUSH((cell)w->pfa);
+  LSPILL();
+  rpush((cell)lip);
+  lip = w->does_ip;
+#if KFORTH_PROFILE
+  if(vm->prof_on) prof_enter((int)(w - vm->dict));
+#endif
+#if KFORTH_JIT
+  if((jf = jit_lookup((int)(w - vm->dict))) != NULL) goto op_native;
+#endif
+#if KFORTH_APP
+  if((af = app_word((int)(w - vm->dict))) != NULL) goto op_app;
+#endif
+  goto next;
+op_tail:     /* W EXIT: W returns to our caller, so push nothing */
+  v = vm->code_mem[lip];
+  if(v < 0 || v >= vm->dict_n || vm->dict[v].cfa != XT_DOCOL) goto op_call;
+#if KFORTH_PROFILE
+  if(vm->prof_on) goto op_call;
+#endif
+  LSPILL();
+  w = &vm->dict[v];
+  lip = w->pfa;
+#if KFORTH_JIT
+  if((jf = jit_lookup((int)v)) != NULL) goto op_native;
+#endif
+#if KFORTH_APP
+  if((af = app_word((int)v)) != NULL) goto op_app;
+#endif
+  goto next;
+#if KFORTH_JIT
+op_native:   /* the body runs natively from its entry, RS already pushed */
+  vm->ip = lip;
+  SPILL();
+  vm->jit_active++;
+  jf(vm);
+  vm->jit_active--;
+  if(!vm->running) return;
+  FILL();
+  lip = vm->ip;
+  goto next;
+#endif
+#if KFORTH_APP
+op_app:      /* SAVE-C body, entered like op_native */
+  vm->ip = lip;
+  SPILL();
+  af();
+  if(!vm->running) return;
+  FILL();
+  lip = vm->ip;
+  goto next;
+#endif
+
+op_drop:
+  NEED(1);
+  DROP1();
+  goto next;
+op_dup:
+  NEED(1);
+  PUSH(T);
+  goto next;
+op_swap:
+  NEED(2);
+  a = T; T = NOS; NOS = a;
+  goto next;
+op_over:
+  NEED(2);
+  PUSH(NOS);
+  goto next;
+
+op_add:
+  NEED(2);
+  a = (cell)((ucell)NOS + (ucell)T); DROP1(); T = a;
+  goto next;
+op_sub:
+  NEED(2);
+  a = (cell)((ucell)NOS - (ucell)T); DROP1(); T = a;
+  goto next;
+op_and:
+  NEED(2);
+  a = NOS & T; DROP1(); T = a;
+  goto next;
+op_or:
+  NEED(2);
+  a = NOS | T; DROP1(); T = a;
+  goto next;
+op_xor:
+  NEED(2);
+  a = NOS ^ T; DROP1(); T = a;
+  goto next;
+op_zeq:
+  NEED(1);
+  T = (T == 0) ? (cell)-1 : 0;
+  goto next;
+op_0lt:
+  NEED(1);
+  T = (T < 0) ? (cell)-1 : 0;
+  goto next;
+
+op_fetch:
+  NEED(1);
+  a = T;
+  T = (ucell)a < (ucell)MEM_DATA_CELLS ? vm->data_mem[(ucell)a] : fetch_far(a);
+  goto next;
+op_store:
+  NEED(2);
+  a = T; v = NOS; DROP1(); DROP1();
+  if(a < 0 || (ucell)a >= (ucell)MEM_DATA_CELLS){ out_err_i("! bad ", a); vm_exit(1); }
+  vm->data_mem[(ucell)a] = v;
+  goto next;
+op_cat:
+  NEED(1);
+  a = T;
+  T = (ucell)a < (ucell)MEM_DATA_BYTES ? (cell)fetch_byte((ucell)a) : (cell)*fetch_at(a, 1, "C@ bad ");
+  goto next;
+op_cstore:
+  NEED(2);
+  a = T; v = NOS; DROP1(); DROP1();
+  if((ucell)a >= (ucell)MEM_DATA_BYTES){ out_err_i("C! bad ", a); vm_exit(1); }
+  store_byte((ucell)a, (uint8_t)(v & 0xFF));
+  goto next;
+
+op_tor:
+  NEED(1);
+  a = T; DROP1();
+  LSPILL();
+  rpush(a);
+  goto next;
+op_rfrom:
+  LSPILL();
+  a = rpop();
+  PUSH(a);
+  goto next;
+op_rat:
+  LSPILL();
+  if(vm->rsp <= 0){ out_err("R@ underflow"); vm_exit(1); }
+  PUSH(vm->RS[vm->rsp-1]);
+  goto next;
+
+op_do:
+  if(vm->data_mem[A_STATE] != 0) goto op_call;
+  NEED(2);
+  a = T; v = NOS; DROP1(); DROP1();   /* index, limit */
+  LSPILL();
+  li = a; ll = v; lc = 1;
+  goto next;
+op_xqdo:
+  off = vm->code_mem[lip++];
+  NEED(2);
+  a = T; v = NOS; DROP1(); DROP1();
+  if(a == v){ lip = (ucell)((cell)lip + off); goto next; }
+  LSPILL();
+  li = a; ll = v; lc = 1;
+  goto next;
+op_loop:
+  if(vm->data_mem[A_STATE] != 0) goto op_call;
+  off = vm->code_mem[lip++];
+  LFILL();
+  li = (cell)((ucell)li + 1u);
+  if(li != ll) lip = (ucell)((cell)lip + off);
+  else lc = 0;
+  goto next;
+op_ploop:
+  if(vm->data_mem[A_STATE] != 0) goto op_call;
+  off = vm->code_mem[lip++];
+  NEED(1);
+  v = T; DROP1();
+  LFILL();
+  if(loop_crossed(li, ll, v)) lc = 0;
+  else{ li = (cell)((ucell)li + (ucell)v); lip = (ucell)((cell)lip + off); }
+  goto next;
+op_xleave:
+  off = vm->code_mem[lip++];
+  if(lc) lc = 0;
+  else{
+    if(vm->rsp < 2){ out_err("LEAVE RS underflow"); vm_exit(1); }
+    vm->rsp -= 2;
+  }
+  lip = (ucell)((cell)lip + off);
+  goto next;
+op_i:
+  if(lc){ PUSH(li); goto next; }
+  if(vm->rsp < 2){ out_err("I RS underflow"); vm_exit(1); }
+  PUSH(vm->RS[vm->rsp-1]);
+  goto next;
+op_iadd:
+op_iaddfetch:
+  if(lc) a = li;
+  else{
+    if(vm->rsp < 2){ out_err("I RS underflow"); vm_exit(1); }
+    a = vm->RS[vm->rsp-1];
+  }
+  NEED(1);
+  a = (cell)((ucell)T + (ucell)a);
+  if(xt == XT_IADD){ T = a; goto next; }
+  T = (ucell)a < (ucell)MEM_DATA_CELLS ? vm->data_mem[(ucell)a] : fetch_far(a);
+  goto next;
+
+op_litadd:
+  v = vm->code_mem[lip++];
+  NEED(1);
+  T = (cell)((ucell)T + (ucell)v);
+  goto next;
+op_litand:
+  v = vm->code_mem[lip++];
+  NEED(1);
+  T &= v;
+  goto next;
+op_litlshift:
+  v = vm->code_mem[lip++];
+  NEED(1);
+  T = ((ucell)v >= (ucell)CELL_BITS) ? 0 : (cell)((ucell)T << (ucell)v);
+  goto next;
+op_litrshift:
+  v = vm->code_mem[lip++];
+  NEED(1);
+  T = ((ucell)v >= (ucell)CELL_BITS) ? 0 : (cell)((ucell)T >> (ucell)v);
+  goto next;
+op_litfetch:
+  a = vm->code_mem[lip++];
+  PUSH((ucell)a < (ucell)MEM_DATA_CELLS ? vm->data_mem[(ucell)a] : fetch_far(a));
+  goto next;
+op_litstore:
+  a = vm->code_mem[lip++];
+  NEED(1);
+  v = T; DROP1();
+  if(a < 0 || (ucell)a >= (ucell)MEM_DATA_CELLS){ out_err_i("! bad ", a); vm_exit(1); }
+  vm->data_mem[(ucell)a] = v;
+  goto next;
+op_dup0branch:
+  if(vm->data_mem[A_STATE] != 0) goto op_call;
+  off = vm->code_mem[lip++];
+  NEED(1);
+  if(T == 0) lip = (ucell)((cell)lip + off);
+  goto next;
+op_zeq0branch:
+  if(vm->data_mem[A_STATE] != 0) goto op_call;
+  off = vm->code_mem[lip++];
+  NEED(1);
+  a = T; DROP1();
+  if(a != 0) lip = (ucell)((cell)lip + off);
+  goto next;
+op_2dup:
+  NEED(2);
+  a = NOS; v = T;
+  PUSH(a);
+  PUSH(v);
+  goto next;
+}
+
+#undef T
+#undef SPILL
+#undef FILL
+#undef LSPILL
+#undef LFILL
+#undef NOS
+#undef NEED
+#undef PUSH
+#undef DROP1
+#endif
+
+/* ===== C-side defining words (needed to load bootstrap) ===== */
+
+static void compile_wordtok(int wi){ ccomma(MK_WORDTOK(wi)); }
+
+#if !KFORTH_APP
+static int parse_number_c(const char *s, cell *out){
+  char *end=NULL;
+  long v = strtol(s, &end, 0);
+  if(end==s || *end!=0) return 0;
+  if(v < INT32_MIN || v > INT32_MAX) return 0;
+  *out = (cell)v;
+  return 1;
+}
+#endif
+
+#if !KFORTH_APP
+static void p_COLON(void){
+  char name[128];
+  if(!next_token(name, sizeof(name))){ out_err(": needs name"); return; }
+  vm->def_mark.here_code = vm->here_code;
+  vm->def_mark.here_data = vm->here_data;
+  vm->def_mark.dict_n = vm->dict_n;
+  vm->def_mark.latest = vm->latest;
+  vm->def_mark.last_created = vm->last_created;
+  int wi = add_word(name, XT_DOCOL, 0);
+  vm->dict[wi].pfa = vm->here_code;
+  vm->compiling = 1;
+  vm->current_def = wi;
+  vm->leave_link = -2;
+  vm->data_mem[A_STATE] = 1;
+}
+#endif
+#if KFORTH_PEEPHOLE || KFORTH_INLINE_CELLS
+/* ===== ; optimizer: inline short words, fuse common sequences ===== */
+/*
+  Both passes rewrite the body [pfa, here_code) of the word just finished.
+  Branch targets (and the entry after (DOES>)) are never fused across, and
+  branch offsets are relocated afterwards. Bodies that do not decode
+  cleanly, or are longer than PEEP_MAX cells, are left untouched.
+*/
+enum { PEEP_MAX = 1024 };
+enum { PC_INSN = 1, PC_TARGET = 2, PC_RELOC = 4 };
+#if !KFORTH_APP   /* run by ; */
+static KF_THREAD_LOCAL uint8_t pc[PEEP_MAX + 1];
+static KF_THREAD_LOCAL uint16_t newpos[PEEP_MAX + 1];
+
+/* mark instruction starts and branch targets in pc[]; 0 if undecodable */
+static int body_scan(ucell pfa, ucell n){
+  if(n > PEEP_MAX) return 0;
+  memset(pc, 0, n + 1);
+  for(ucell a=0; a<n; ){
+    cell xt = cell_xt(vm->code_mem[pfa + a]);
+    if(xt < 0) return 0;
+    pc[a] |= PC_INSN;
+    if(xt_has_operand((ucell)xt)){
+      if(a + 1 >= n) return 0;
+      if(xt_is_branch((ucell)xt)){
+        cell t = (cell)(a + 2) + vm->code_mem[pfa + a + 1];
+        if(t < 0 || (ucell)t > n) return 0;
+        pc[t] |= PC_TARGET;
+      }
+      a += 2;
+    }else{
+      if((ucell)xt == XT_XDOES) pc[a + 1] |= PC_TARGET;
+      a += 1;
+    }
+  }
+  for(ucell a=0; a<n; a++){
+    if((pc[a] & PC_TARGET) && !(pc[a] & PC_INSN)) return 0;
+  }
+  return 1;
+}
+#endif
+
+/* DOCOL word whose body holds code address a, or -1 */
+static int code_owner(ucell a){
+  int best = -1;
+  if(a >= vm->here_code) return -1;
+  for(int i=0;i<vm->dict_n;i++){
+    if(vm->dict[i].cfa == XT_DOCOL && vm->dict[i].pfa <= a && (best < 0 || vm->dict[i].pfa > vm->dict[best].pfa)) best = i;
+  }
+  return best;
+}
+
+#if !KFORTH_APP   /* run by ; */
+/*
+  wi only pops return-stack cells it pushed itself (no R> or R@ below its
+  own >R, no ACTIVATE), so it runs the same whichever frame it is entered
+  from: a caller may copy a call to it inline, or jump to it as a tail call.
+*/
+static int rs_private(int wi){
+  Word *w = &vm->dict[wi];
+  ucell start;
+  if(w->cfa == XT_DOCOL) start = w->pfa;
+  else if(w->cfa == XT_DODOES) start = w->does_ip;
+  else return 1;
+  ucell end = vm->here_code;
+  for(int i=0;i<vm->dict_n;i++){
+    if(vm->dict[i].cfa == XT_DOCOL && vm->dict[i].pfa > start && vm->dict[i].pfa < end) end = vm->dict[i].pfa;
+  }
+  int rdepth = 0;
+  for(ucell a = start; a < end; ){
+    cell xt = cell_xt(vm->code_mem[a]);
+    if(xt < 0) return 0;
+    ucell x = (ucell)xt;
+    if(x == XT_TOR) rdepth++;
+    else if(x == XT_RFROM){ if(--rdepth < 0) return 0; }
+    else if(x == XT_RAT){ if(rdepth == 0) return 0; }
+#if KFORTH_TASKS
+    else if(x == XT_ACTIVATE) return 0;
+#endif
+    a += xt_has_operand(x) ? 2 : 1;
+  }
+  return 1;
+}
+
+/* operand cells flagged PC_RELOC hold old body-relative targets */
+static void body_reloc(ucell pfa, ucell o){
+  for(ucell a=0; a<o; a++){
+    if(pc[a] & PC_RELOC){
+      pc[a] &= (uint8_t)~PC_RELOC;
+      vm->code_mem[pfa + a] = (cell)newpos[vm->code_mem[pfa + a]] - (cell)(a + 1);
+    }
+  }
+  vm->here_code = pfa + o;
+}
+#endif
+#endif
+
+#if KFORTH_INLINE_CELLS
+
+#if !KFORTH_APP   /* run by ; */
+/*
+  Straight-line body of wi up to its first EXIT, if it is short enough to
+  copy into a caller: no branches or loop words, no EXECUTE/(DOES>), >R/R>
+  balanced so it never touches the caller's return-stack frame, and no call
+  to a word that reaches into the frame it was called from.
+*/
+static int inline_body(int wi, ucell *start, ucell *len){
+  Word *w = &vm->dict[wi];
+  if(w->immediate || w->noinline || wi == vm->current_def) return 0;
+  if(w->cfa == XT_DOCOL) *start = w->pfa;
+  else if(w->cfa == XT_DODOES){
+    int owner = code_owner(w->does_ip);
+    if(owner < 0 || vm->dict[owner].noinline) return 0;
+    *start = w->does_ip;
+  }else return 0;
+
+  int rdepth = 0;
+  for(ucell a = *start; a < vm->here_code && a - *start <= (ucell)KFORTH_INLINE_CELLS; ){
+    cell c = vm->code_mem[a];
+    cell xt = cell_xt(c);
+    if(xt < 0) return 0;
+    ucell x = (ucell)xt;
+    if(x == XT_EXIT){
+      *len = a - *start;
+      return rdepth == 0;
+    }
+    if(xt_is_branch(x) || x == XT_DO || x == XT_I || x == XT_J || x == XT_UNLOOP ||
+       x == XT_EXECUTE || x == XT_XDOES || x == XT_TAIL || x == XT_IADD || x == XT_IADDFETCH) return 0;
+#if KFORTH_TASKS
+    if(x == XT_ACTIVATE) return 0;   /* it returns from the definition it is in */
+#endif
+    if(!IS_WORDTOK(c) && (x == XT_DOCOL || x == XT_DOVAR || x == XT_DODOES)) return 0;
+    if(IS_WORDTOK(c) && !rs_private(WORD_ID(c))) return 0;
+    if(x == XT_TOR) rdepth++;
+    else if(x == XT_RFROM){ if(--rdepth < 0) return 0; }
+    else if(x == XT_RAT){ if(rdepth == 0) return 0; }
+    a += xt_has_operand(x) ? 2 : 1;
+  }
+  return 0;
+}
+
+/* expand calls to short words in place; the body only grows */
+static void inline_calls(ucell pfa){
+  static KF_THREAD_LOCAL cell src[PEEP_MAX];
+  ucell n = vm->here_code - pfa;
+  if(!vm->inline_on || !body_scan(pfa, n)) return;
+  memcpy(src, &vm->code_mem[pfa], n * sizeof(cell));
+
+  ucell r = 0, o = 0;
+  while(r < n){
+    cell c0 = src[r];
+    ucell x0 = (ucell)cell_xt(c0);
+    ucell len = xt_has_operand(x0) ? 2 : 1;
+    ucell start = 0, blen = 0;
+    newpos[r] = (uint16_t)o;
+    if(IS_WORDTOK(c0) && inline_body(WORD_ID(c0), &start, &blen)){
+      Word *w = &vm->dict[WORD_ID(c0)];
+      ucell lead = (w->cfa == XT_DODOES) ? 2 : 0;
+      if(o + lead + blen + (n - r) <= PEEP_MAX && pfa + o + lead + blen + (n - r) <= MEM_CODE_CELLS){
+        if(lead){
+          vm->code_mem[pfa + o] = MK_WORDTOK(WI_LIT);
+          vm->code_mem[pfa + o + 1] = (cell)w->pfa;
+        }
+        memmove(&vm->code_mem[pfa + o + lead], &vm->code_mem[start], blen * sizeof(cell));
+        o += lead + blen;
+        r += 1;
+        continue;
+      }
+    }
+    vm->code_mem[pfa + o] = c0;
+    if(len == 2){
+      cell v = src[r + 1];
+      if(xt_is_branch(x0)){ v = (cell)(r + 2) + v; pc[o + 1] |= PC_RELOC; }
+      vm->code_mem[pfa + o + 1] = v;
+    }
+    o += len;
+    r += len;
+  }
+  newpos[n] = (uint16_t)o;
+  body_reloc(pfa, o);
+}
+#endif
+
+static void p_INLINEON(void){ vm->inline_on = 1; }
+static void p_INLINEOFF(void){ vm->inline_on = 0; }
+static void p_NOINLINE(void){
+  if(vm->latest < 0){ out_err("NOINLINE no latest"); return; }
+  vm->dict[vm->latest].noinline = 1;
+}
+#endif
+
+#if KFORTH_PEEPHOLE
+#if !KFORTH_APP   /* run by ; */
+/* a tail call reuses the caller's frame: only for a callee that leaves it alone */
+static int tail_ok(int wi){
+  return !vm->dict[wi].noinline && rs_private(wi);
+}
+
+static void peephole(ucell pfa){
+  ucell n = vm->here_code - pfa;
+  if(!body_scan(pfa, n)) return;
+  int self_tail = vm->current_def >= 0 && tail_ok(vm->current_def);   /* before the body is rewritten */
+
+  ucell r = 0, o = 0;
+  while(r < n){
+    cell c0 = vm->code_mem[pfa + r];
+    ucell x0 = (ucell)cell_xt(c0);
+    ucell len = xt_has_operand(x0) ? 2 : 1;
+    ucell x1 = (r + len < n && !(pc[r + len] & PC_TARGET)) ? (ucell)cell_xt(vm->code_mem[pfa + r + len]) : (ucell)-1;
+    cell fx = -1, arg = 0;
+    ucell used = len;
+
+    if(x0 == XT_LIT){
+      arg = vm->code_mem[pfa + r + 1];
+      used = 3;
+      if(x1 == XT_ADD) fx = (cell)XT_LITADD;
+      else if(x1 == XT_SUB){ fx = (cell)XT_LITADD; arg = (cell)(0u - (ucell)arg); }
+      else if(x1 == XT_AND) fx = (cell)XT_LITAND;
+      else if(x1 == XT_LSHIFT) fx = (cell)XT_LITLSHIFT;
+      else if(x1 == XT_RSHIFT) fx = (cell)XT_LITRSHIFT;
+      else if(x1 == XT_FETCH) fx = (cell)XT_LITFETCH;
+      else if(x1 == XT_STORE) fx = (cell)XT_LITSTORE;
+    }else if(x0 == XT_DOVAR && IS_WORDTOK(c0)){
+      arg = (cell)vm->dict[WORD_ID(c0)].pfa;
+      used = 2;
+      if(x1 == XT_FETCH) fx = (cell)XT_LITFETCH;
+      else if(x1 == XT_STORE) fx = (cell)XT_LITSTORE;
+    }else if(x0 == XT_DUP || x0 == XT_ZEQ){
+      if(x1 == XT_0BRANCH){
+        fx = (cell)(x0 == XT_DUP ? XT_DUP0BRANCH : XT_ZEQ0BRANCH);
+        arg = (cell)(r + 3) + vm->code_mem[pfa + r + 2];
+        used = 3;
+      }
+    }else if(x0 == XT_OVER && x1 == XT_OVER){
+      fx = (cell)XT_2DUP;
+      used = 2;
+    }else if(x0 == XT_I && x1 == XT_ADD){
+      ucell x2 = (r + 2 < n && !(pc[r + 2] & PC_TARGET)) ? (ucell)cell_xt(vm->code_mem[pfa + r + 2]) : (ucell)-1;
+      fx = (cell)(x2 == XT_FETCH ? XT_IADDFETCH : XT_IADD);
+      used = x2 == XT_FETCH ? 3 : 2;
+    }else if(x0 == XT_DOCOL && IS_WORDTOK(c0) && x1 == XT_EXIT &&
+             (WORD_ID(c0) == vm->current_def ? self_tail : tail_ok(WORD_ID(c0)))){
+      fx = (cell)XT_TAIL;   /* the EXIT cell carries the word */
+      arg = (cell)WORD_ID(c0);
+      used = 2;
+    }
+
+    newpos[r] = (uint16_t)o;
+    if(fx >= 0){
+      vm->code_mem[pfa + o] = fx;
+      if(xt_has_operand((ucell)fx)){
+        vm->code_mem[pfa + o + 1] = arg;
+        if(xt_is_branch((ucell)fx)) pc[o + 1] |= PC_RELOC;
+        o += 2;
+      }else{
+        o += 1;
+      }
+      r += used;
+    }else{
+      vm->code_mem[pfa + o] = c0;
+      if(len == 2){
+        cell v = vm->code_mem[pfa + r + 1];
+        if(xt_is_branch(x0)){ v = (cell)(r + 2) + v; pc[o + 1] |= PC_RELOC; }
+        vm->code_mem[pfa + o + 1] = v;
+      }
+      o += len;
+      r += len;
+    }
+  }
+  newpos[n] = (uint16_t)o;
+  body_reloc(pfa, o);
+}
+#endif
+
+/* CODE! into a fused (TAIL) pair: split it back into "W EXIT" first */
+static void untail(ucell a){
+  int owner = code_owner(a);
+  if(owner < 0) return;
+  for(ucell p = vm->dict[owner].pfa; p <= a; ){
+    cell xt = cell_xt(vm->code_mem[p]);
+    if(xt < 0) return;
+    if((ucell)xt == XT_TAIL){
+      if(a <= p + 1){
+        vm->code_mem[p] = MK_WORDTOK(vm->code_mem[p + 1]);
+        vm->code_mem[p + 1] = (cell)XT_EXIT;
+        return;
+      }
+    }
+    p += xt_has_operand((ucell)xt) ? 2 : 1;
+  }
+}
+#endif
+
+#if !KFORTH_APP
 static void p_SEMI(void){
-  if(!compiling){ out_err("; outside"); return; }
+  if(!vm->compiling){ out_err("; outside"); return; }
   ccomma((cell)XT_EXIT);
-  compiling = 0;
-  current_def = -1;
-  data_mem[A_STATE] = 0;
+#if KFORTH_INLINE_CELLS
+  if(vm->current_def >= 0) inline_calls(vm->dict[vm->current_def].pfa);
+#endif
+#if KFORTH_PEEPHOLE
+  if(vm->current_def >= 0) peephole(vm->dict[vm->current_def].pfa);
+#endif
+  vm->compiling = 0;
+  vm->current_def = -1;
+  vm->data_mem[A_STATE] = 0;
 }
+#endif
 static void p_IMMEDIATE(void){
-  if(latest < 0){ out_err("IMMEDIATE no latest"); return; }
-  dict[latest].immediate = 1;
+  if(vm->latest < 0){ out_err("IMMEDIATE no latest"); return; }
+  vm->dict[vm->latest].immediate = 1;
 }
+#if !KFORTH_APP
 static void p_CREATE(void){
   char name[128];
   if(!next_token(name, sizeof(name))){ out_err("CREATE needs name"); return; }
   int wi = add_word(name, XT_DOVAR, 0);
-  dict[wi].pfa = here_data;
-  last_created = wi;
+  vm->dict[wi].pfa = vm->here_data;
+  vm->last_created = wi;
 }
 static void p_DOES(void){
-  if(!compiling){ out_err("DOES> only during compile"); return; }
-  if(XT_XDOES >= (ucell)prim_n){ out_err("no (DOES>)"); exit(1); }
+  if(!vm->compiling){ out_err("DOES> only during compile"); return; }
+  if(XT_XDOES >= (ucell)prim_n){ out_err("no (DOES>)"); vm_exit(1); }
   ccomma((cell)XT_XDOES);
 }
+#endif
+
+#if KFORTH_IMAGE || KFORTH_SAVE_C || KFORTH_APP
+/* ===== build id: saved VMs only load into a matching build ===== */
+/*
+  Primitive xts are not stored in images or SAVE-C output: build_id covers
+  the memory layout and the init_core() word set, so saved code only runs in
+  a build that assigns the same XT_* values. Names are left out, as a
+  SAVE-C program registers its core words without them.
+*/
+enum { IMAGE_MAGIC = 0x4D49464Bu /* "KFIM" */, IMAGE_VERSION = 1 };
+
+static uint32_t image_build_id = 0;   /* set at the end of init_core() */
+
+/* FNV-1a over 32-bit words (all image sections are whole words) */
+static uint32_t image_hash(uint32_t h, const void *p, size_t n){
+  const uint8_t *b = (const uint8_t *)p;
+  for(size_t i=0; i+4<=n; i+=4){
+    uint32_t w;
+    memcpy(&w, b + i, 4);
+    h = (h ^ w) * 16777619u;
+  }
+  return h;
+}
+
+static uint32_t core_build_id(void){
+  uint32_t k[] = { IMAGE_VERSION, CELL_BYTES, MEM_CODE_CELLS, MEM_DATA_CELLS, DICT_MAX,
+                   DICT_HASH, NAME_MAX, (uint32_t)sizeof(Word), PRIM_MAX, (uint32_t)prim_n,
+                   (uint32_t)vm->dict_n, KFORTH_INLINE_CELLS, KFORTH_NATIVE_FLOAT,
+                   KFORTH_TASKS, KFORTH_TASK_STACK, KFORTH_TASK_USER, KFORTH_FILES, HEAP_CELLS, TRANS_BYTES };
+  uint32_t h = image_hash(2166136261u, k, sizeof(k));
+  for(int i=0;i<vm->dict_n;i++){
+    const Word *w = &vm->dict[i];
+    uint32_t f[] = { w->cfa, w->pfa, w->does_ip, w->immediate };
+    h = image_hash(h, f, sizeof(f));
+  }
+  return h;
+}
+#endif
+
+#if KFORTH_IMAGE && !KFORTH_APP
+/* ===== VM image: SAVE-IMAGE / --image ===== */
+/*
+  header, then code_mem[0,here_code), data_mem[0,here_data), dict[0,dict_n)
+  and dict_hash[], all in host byte order.
+*/
+typedef struct ImageHdr {
+  uint32_t magic, version, build_id, sum;
+  uint32_t here_code, here_data;
+  int32_t  dict_n, latest, last_created;
+  int32_t  wi_lit, wi_type, wi_abortq;
+  int32_t  prompt_mode, inline_on;
+} ImageHdr;
+
+static int image_sections(const ImageHdr *h, const void *sec[4], size_t len[4]){
+  if(h->here_code > vm->code_max || h->here_data > vm->data_max) return 0;
+  if(h->dict_n < 0 || h->dict_n > vm->dict_max) return 0;
+  sec[0] = vm->code_mem;  len[0] = (size_t)h->here_code * sizeof(cell);
+  sec[1] = vm->data_mem;  len[1] = (size_t)h->here_data * sizeof(cell);
+  sec[2] = vm->dict;      len[2] = (size_t)h->dict_n * sizeof(Word);
+  sec[3] = vm->dict_hash; len[3] = sizeof(vm->dict_hash);
+  return 1;
+}
+
+/* SAVE-IMAGE ( addr len -- ) write the VM to the named file */
+static void p_SAVEIMAGE(void){
+  char path[256];
+  pop_path(path, "SAVE-IMAGE bad name", "SAVE-IMAGE bad ");
+  if(vm->current_def >= 0 || vm->data_mem[A_STATE] != 0){ runtime_recover("SAVE-IMAGE while compiling"); }
+
+  ImageHdr h = { IMAGE_MAGIC, IMAGE_VERSION, image_build_id, 0,
+                 vm->here_code, vm->here_data, vm->dict_n, vm->latest, vm->last_created,
+                 WI_LIT, WI_TYPE, WI_ABORTQ, vm->prompt_mode, vm->inline_on };
+  const void *sec[4];
+  size_t n[4];
+  (void)image_sections(&h, sec, n);
+  uint32_t sum = 2166136261u;
+  for(int i=0;i<4;i++) sum = image_hash(sum, sec[i], n[i]);
+  h.sum = sum;
+
+  FILE *f = fopen(path, "wb");
+  int ok = f && fwrite(&h, sizeof(h), 1, f) == 1;
+  for(int i=0;i<4 && ok;i++) ok = fwrite(sec[i], 1, n[i], f) == n[i];
+  if(f && fclose(f) != 0) ok = 0;
+  if(!ok){ runtime_recover("SAVE-IMAGE write failed"); }
+}
+
+/* replace the freshly initialised VM with an image file; 0 with a message on error */
+static int load_image(const char *path){
+  FILE *f = fopen(path, "rb");
+  if(!f){ out_err("image open failed"); return 0; }
+  uint8_t *buf = NULL;
+  long size = -1;
+  if(fseek(f, 0, SEEK_END) == 0) size = ftell(f);
+  if(size >= (long)sizeof(ImageHdr) && fseek(f, 0, SEEK_SET) == 0) buf = (uint8_t *)malloc((size_t)size);
+  int ok = buf && fread(buf, 1, (size_t)size, f) == (size_t)size;   /* one read */
+  fclose(f);
+  if(!ok){ free(buf); out_err("image read failed"); return 0; }
+
+  ImageHdr h;
+  memcpy(&h, buf, sizeof(h));
+  const void *sec[4];
+  size_t n[4];
+  const char *why = NULL;
+  if(h.magic != IMAGE_MAGIC || h.version != IMAGE_VERSION || h.build_id != image_build_id ||
+     h.wi_lit != WI_LIT || h.wi_type != WI_TYPE || h.wi_abortq != WI_ABORTQ){
+    why = "image from another build";
+  }else if(!image_sections(&h, sec, n) ||
+           (size_t)size != sizeof(h) + n[0] + n[1] + n[2] + n[3]){
+    why = "image corrupt";
+  }else{
+    uint32_t sum = 2166136261u;
+    size_t off = sizeof(h);
+    for(int i=0;i<4;i++){ sum = image_hash(sum, buf + off, n[i]); off += n[i]; }
+    if(sum != h.sum) why = "image corrupt";
+  }
+  if(why){ free(buf); out_err(why); return 0; }
+
+  size_t off = sizeof(h);
+  for(int i=0;i<4;i++){ memcpy((void *)sec[i], buf + off, n[i]); off += n[i]; }
+  free(buf);
+  vm->here_code = h.here_code;
+  vm->here_data = h.here_data;
+  vm->heap_ready = 0;   /* the heap starts empty */
+  vm->dict_n = h.dict_n;
+  vm->latest = h.latest;
+  vm->last_created = h.last_created;
+  vm->prompt_mode = h.prompt_mode;
+  vm->inline_on = h.inline_on;
+#if KFORTH_JIT
+  jit_flush();
+#endif
+  vm->data_mem[A_STATE] = 0;
+  vm->data_mem[A_IN] = 0;
+  vm->data_mem[A_NTIB] = 0;
+  return 1;
+}
+#endif
+#if KFORTH_SAVE_C && !KFORTH_APP
+/* ===== SAVE-C: the loaded dictionary as C source ===== */
+/*
+  S" app.c" SAVE-C MAIN writes a C file that includes kforth.c with
+  KFORTH_APP set and runs MAIN with no outer interpreter. Each colon and
+  DOES> body becomes a C function: LIT, branches and loops turn into C
+  statements and labels, primitives are called directly by name. Code,
+  data and the words added after init_core() (without their names) are
+  stored as arrays. A C body hands over to the inner interpreter wherever
+  it cannot run as saved: STATE set under a branch, a call that returns
+  somewhere else, or CODE! into saved code.
+*/
+static int core_dict_n;   /* words made by init_core(), set with image_build_id */
+
+/* body of a DOCOL/DODOES word, 0 for other words */
+static int save_c_entry(int wi, ucell *entry){
+  const Word *w = &vm->dict[wi];
+  if(w->cfa == XT_DOCOL) *entry = w->pfa;
+  else if(w->cfa == XT_DODOES) *entry = w->does_ip;
+  else return 0;
+  return *entry < vm->here_code;
+}
+
+static const char *save_c_num(char *buf, cell v){
+  if(v == INT32_MIN) return "(-2147483647 - 1)";
+  sprintf(buf, "%ld", (long)v);
+  return buf;
+}
+
+static void save_c_word(FILE *f, int wi, ucell at, ucell ret, const uint8_t *has_fn){
+  const Word *w = &vm->dict[wi];
+  ucell e;
+  if(save_c_entry(wi, &e) && has_fn[e]){
+    if(w->cfa == XT_DOCOL)
+      fprintf(f, "  if(vm->dict[%d].cfa == XT_DOCOL){ vm->dsp = sp; rpush(%u); app_%u(); }\n", wi, ret, e);
+    else
+      fprintf(f, "  if(vm->dict[%d].cfa == XT_DODOES && vm->dict[%d].does_ip == %uu){\n"
+                 "    APP_ROOM(1, %uu); ds[sp++] = %u; vm->dsp = sp; rpush(%u); app_%u();\n  }\n",
+              wi, wi, e, at, w->pfa, ret, e);
+    fprintf(f, "  else{ vm->dsp = sp; app_call(%d, %uu); }\n  sp = vm->dsp;\n  APP_CHECK(%uu);\n", wi, ret, ret);
+  }else if(w->cfa == XT_DOVAR){
+    fprintf(f, "  if(vm->dict[%d].cfa == XT_DOVAR){ APP_ROOM(1, %uu); ds[sp++] = %u; }\n"
+               "  else{ vm->dsp = sp; app_call(%d, %uu); sp = vm->dsp; APP_CHECK(%uu); }\n",
+            wi, at, w->pfa, wi, ret, ret);
+  }else{
+    fprintf(f, "  vm->dsp = sp;\n  app_call(%d, %uu);\n  sp = vm->dsp;\n  APP_CHECK(%uu);\n", wi, ret, ret);
+  }
+}
+
+/* stack primitives open-coded on ds[sp]; 0 if x is not one of them */
+static int save_c_stackop(FILE *f, ucell x, ucell at){
+  const char *op = x == XT_ADD ? "+" : x == XT_SUB ? "-" : x == XT_AND ? "&" : x == XT_OR ? "|" : x == XT_XOR ? "^" : NULL;
+  if(op){
+    fprintf(f, "  APP_NEED(2, %uu);\n  ds[sp-2] = (cell)((ucell)ds[sp-2] %s (ucell)ds[sp-1]);\n  sp--;\n", at, op);
+  }else if(x == XT_DUP){
+    fprintf(f, "  APP_NEED(1, %uu);\n  APP_ROOM(1, %uu);\n  ds[sp] = ds[sp-1];\n  sp++;\n", at, at);
+  }else if(x == XT_DROP){
+    fprintf(f, "  APP_NEED(1, %uu);\n  sp--;\n", at);
+  }else if(x == XT_SWAP){
+    fprintf(f, "  APP_NEED(2, %uu);\n  { cell t_ = ds[sp-1]; ds[sp-1] = ds[sp-2]; ds[sp-2] = t_; }\n", at);
+  }else if(x == XT_OVER){
+    fprintf(f, "  APP_NEED(2, %uu);\n  APP_ROOM(1, %uu);\n  ds[sp] = ds[sp-2];\n  sp++;\n", at, at);
+  }else if(x == XT_2DUP){
+    fprintf(f, "  APP_NEED(2, %uu);\n  APP_ROOM(2, %uu);\n  ds[sp] = ds[sp-2];\n  ds[sp+1] = ds[sp-1];\n  sp += 2;\n", at, at);
+  }else if(x == XT_ZEQ || x == XT_0LT){
+    fprintf(f, "  APP_NEED(1, %uu);\n  ds[sp-1] = ds[sp-1] %s 0 ? -1 : 0;\n", at, x == XT_ZEQ ? "==" : "<");
+  }else if(x == XT_FETCH){
+    fprintf(f, "  APP_NEED(1, %uu);\n  if((ucell)ds[sp-1] >= (ucell)MEM_DATA_CELLS) APP_BAIL(%uu);\n"
+               "  ds[sp-1] = vm->data_mem[ds[sp-1]];\n", at, at);
+  }else if(x == XT_STORE){
+    fprintf(f, "  APP_NEED(2, %uu);\n  if((ucell)ds[sp-1] >= (ucell)MEM_DATA_CELLS) APP_BAIL(%uu);\n"
+               "  vm->data_mem[ds[sp-1]] = ds[sp-2];\n  sp -= 2;\n", at, at);
+  }else if(x == XT_I || x == XT_RAT){
+    fprintf(f, "  if(vm->rsp < %d) APP_BAIL(%uu);\n  APP_ROOM(1, %uu);\n  ds[sp++] = vm->RS[vm->rsp-1];\n",
+            x == XT_I ? 2 : 1, at, at);
+  }else if(x == XT_IADD){
+    fprintf(f, "  if(vm->rsp < 2) APP_BAIL(%uu);\n  APP_NEED(1, %uu);\n"
+               "  ds[sp-1] = (cell)((ucell)ds[sp-1] + (ucell)vm->RS[vm->rsp-1]);\n", at, at);
+  }else if(x == XT_IADDFETCH){
+    fprintf(f, "  if(vm->rsp < 2) APP_BAIL(%uu);\n  APP_NEED(1, %uu);\n"
+               "  { ucell a_ = (ucell)ds[sp-1] + (ucell)vm->RS[vm->rsp-1];\n"
+               "    if(a_ >= (ucell)MEM_DATA_CELLS) APP_BAIL(%uu);\n    ds[sp-1] = vm->data_mem[a_]; }\n", at, at, at);
+  }else if(x == XT_TOR){
+    fprintf(f, "  APP_NEED(1, %uu);\n  if(vm->rsp >= RS_DEPTH) APP_BAIL(%uu);\n  vm->RS[vm->rsp++] = ds[--sp];\n", at, at);
+  }else if(x == XT_RFROM){
+    fprintf(f, "  if(vm->rsp < 1) APP_BAIL(%uu);\n  APP_ROOM(1, %uu);\n  ds[sp++] = vm->RS[--vm->rsp];\n", at, at);
+  }else if(x == XT_DO){
+    fprintf(f, "  APP_STATE(%uu);\n  APP_NEED(2, %uu);\n  if(vm->rsp > RS_DEPTH - 2) APP_BAIL(%uu);\n"
+               "  vm->RS[vm->rsp] = ds[sp-2];\n  vm->RS[vm->rsp+1] = ds[sp-1];\n  vm->rsp += 2;\n  sp -= 2;\n", at, at, at);
+  }else{
+    return 0;
+  }
+  return 1;
+}
+
+static void save_c_body(FILE *f, ucell entry, const uint8_t *mark, const uint8_t *has_fn){
+  char nb[24];
+  fprintf(f, "\nstatic void app_%u(void){\n  APP_ENTER();\n", entry);
+  for(ucell ip=entry; ip<vm->here_code; ip++){
+    ucell a = ip - entry;
+    if(!(mark[a] & BODY_INSN)) continue;
+    if(mark[a] & BODY_TARGET) fprintf(f, "L%u:\n", ip);
+    cell instr = vm->code_mem[ip];
+    ucell x = (ucell)cell_xt(instr);
+    cell v = xt_has_operand(x) ? vm->code_mem[ip + 1] : 0;
+    ucell next = ip + (xt_has_operand(x) ? 2u : 1u);
+    ucell t = (ucell)((cell)next + v);
+    const char *fn = prim_text[x] ? NULL : prim_cname[x];
+    char fb[32];
+    if(!fn){ sprintf(fb, "prim_table[%u]", x); fn = fb; }
+    int wi = IS_WORDTOK(instr) ? WORD_ID(instr) : -1;
+    if(wi >= 0 && (x == XT_DOCOL || x == XT_DODOES || x == XT_DOVAR)){
+      save_c_word(f, wi, ip, next, has_fn);
+    }else if(wi >= core_dict_n){   /* a later word run by a primitive: as the interpreter would */
+      fprintf(f, "  vm->dsp = sp;\n  app_call(%d, %uu);\n  sp = vm->dsp;\n  APP_CHECK(%uu);\n", wi, ip + 1, next);
+    }else if(x == XT_EXIT){
+      fprintf(f, "  APP_EXIT();\n");
+    }else if(x == XT_XDOES){
+      fprintf(f, "  vm->dsp = sp;\n  vm->ip = %uu;\n  p_XDOES();\n  return;\n", next);
+    }else if(x == XT_LIT){
+      fprintf(f, "  APP_ROOM(1, %uu);\n  ds[sp++] = %s;\n", ip, save_c_num(nb, v));
+    }else if(x == XT_BRANCH){
+      fprintf(f, "  APP_STATE(%uu);\n  goto L%u;\n", ip, t);
+    }else if(x == XT_0BRANCH || x == XT_ZEQ0BRANCH){
+      fprintf(f, "  APP_STATE(%uu);\n  APP_NEED(1, %uu);\n  if(ds[--sp] %s 0) goto L%u;\n",
+              ip, ip, x == XT_0BRANCH ? "==" : "!=", t);
+    }else if(x == XT_DUP0BRANCH){
+      fprintf(f, "  APP_STATE(%uu);\n  APP_NEED(1, %uu);\n  if(ds[sp-1] == 0) goto L%u;\n", ip, ip, t);
+    }else if(x == XT_LOOP){
+      fprintf(f, "  APP_STATE(%uu);\n  if(vm->rsp < 2) APP_BAIL(%uu);\n"
+                 "  { cell *r_ = &vm->RS[vm->rsp-1]; cell i_ = (cell)((ucell)r_[0] + 1u);\n"
+                 "    if(i_ != r_[-1]){ r_[0] = i_; goto L%u; } }\n  vm->rsp -= 2;\n", ip, ip, t);
+    }else if(xt_is_branch(x)){   /* +LOOP: the primitive moves ip */
+      fprintf(f, "  vm->dsp = sp;\n  vm->ip = %uu;\n  %s();\n  sp = vm->dsp;\n  if(vm->ip == %uu) goto L%u;\n  APP_CHECK(%uu);\n",
+              ip + 1, fn, t, t, next);
+    }else if(x == XT_TAIL){   /* to itself: back to the top; otherwise the interpreter enters it */
+      if(mark[0] & BODY_TARGET && v >= 0 && v < vm->dict_n && vm->dict[v].pfa == entry)
+        fprintf(f, "  if(vm->dict[%d].cfa == XT_DOCOL) goto L%u;\n", (int)v, entry);
+      fprintf(f, "  vm->dsp = sp;\n  vm->ip = %uu;\n  p_TAIL();\n  return;\n", ip + 1);
+    }else if(x == XT_LITADD || x == XT_LITAND){
+      fprintf(f, "  APP_NEED(1, %uu);\n  ds[sp-1] = (cell)((ucell)ds[sp-1] %s %uu);\n", ip, x == XT_LITADD ? "+" : "&", (ucell)v);
+    }else if(x == XT_LITLSHIFT || x == XT_LITRSHIFT){
+      if((ucell)v >= (ucell)CELL_BITS) fprintf(f, "  APP_NEED(1, %uu);\n  ds[sp-1] = 0;\n", ip);
+      else fprintf(f, "  APP_NEED(1, %uu);\n  ds[sp-1] = (cell)((ucell)ds[sp-1] %s %u);\n", ip, x == XT_LITLSHIFT ? "<<" : ">>", (ucell)v);
+    }else if((x == XT_LITFETCH || x == XT_LITSTORE) && v >= 0 && (ucell)v < (ucell)MEM_DATA_CELLS){
+      if(x == XT_LITFETCH) fprintf(f, "  APP_ROOM(1, %uu);\n  ds[sp++] = vm->data_mem[%d];\n", ip, (int)v);
+      else fprintf(f, "  APP_NEED(1, %uu);\n  vm->data_mem[%d] = ds[--sp];\n", ip, (int)v);
+    }else if(save_c_stackop(f, x, ip)){
+      continue;
+    }else{
+      fprintf(f, "  APP_PRIM(%s, %uu, %uu);\n", fn, ip + 1, next);
+    }
+  }
+  fprintf(f, "}\n");
+}
+
+static void save_c_array(FILE *f, const char *decl, const cell *p, ucell n){
+  fprintf(f, "\n%s[] = {", decl);
+  for(ucell i=0;i<n;i++) fprintf(f, "%s0x%x,", i % 8 ? " " : "\n  ", (unsigned)p[i]);
+  fprintf(f, "\n  0\n};\n");
+}
+
+static void save_c_define(FILE *f, const char *name, long v){
+  fprintf(f, "#ifndef %s\n#define %s %ld\n#endif\n", name, name, v);
+}
+
+/* SAVE-C ( addr len "name" -- ) write the VM as C source that runs name */
+static void p_SAVEC(void){
+  char path[256];
+  pop_path(path, "SAVE-C bad name", "SAVE-C bad ");
+  int entry = tick_wi();
+  if(entry < 0){ runtime_recover("SAVE-C ?"); }
+  if(vm->current_def >= 0 || vm->data_mem[A_STATE] != 0){ runtime_recover("SAVE-C while compiling"); }
+
+  ucell here = vm->here_code;
+  uint8_t *has_fn = (uint8_t *)calloc(here + 1, 1);
+  uint8_t *mark = (uint8_t *)malloc(here + 1);
+  FILE *f = (has_fn && mark) ? fopen(path, "w") : NULL;
+  if(!f){ free(has_fn); free(mark); runtime_recover("SAVE-C write failed"); }
+
+  /* bodies that decode get a C function; calls to the others go through the interpreter */
+  ucell e;
+  for(int wi=core_dict_n; wi<vm->dict_n; wi++){
+    if(!save_c_entry(wi, &e) || has_fn[e]) continue;
+    memset(mark, 0, here - e);
+    has_fn[e] = (uint8_t)body_reach(e, here - e, mark);
+  }
+
+  fprintf(f, "/*\n  Generated by SAVE-C: a kforth VM that runs word %d on start.\n"
+             "  Build it against the kforth sources (same options as the saving build):\n"
+             "    cc -O2 -I<kforth> app.c <kforth>/kf_io.c <kforth>/kf_dev.c -o app\n*/\n", entry);
+  save_c_define(f, "KFORTH_MEM_CODE_CELLS", MEM_CODE_CELLS);
+  save_c_define(f, "KFORTH_MEM_DATA_CELLS", MEM_DATA_CELLS);
+  save_c_define(f, "KFORTH_DS_DEPTH", DS_DEPTH);
+  save_c_define(f, "KFORTH_RS_DEPTH", RS_DEPTH);
+  save_c_define(f, "KFORTH_DICT_MAX", DICT_MAX);
+  save_c_define(f, "KFORTH_DICT_HASH", DICT_HASH);
+  save_c_define(f, "KFORTH_HEAP_CELLS", HEAP_CELLS);
+  save_c_define(f, "KFORTH_TRANSIENT_BYTES", TRANS_BYTES);
+  save_c_define(f, "KFORTH_INLINE_CELLS", KFORTH_INLINE_CELLS);
+  save_c_define(f, "KFORTH_NATIVE_FLOAT", KFORTH_NATIVE_FLOAT);
+  save_c_define(f, "KFORTH_IMAGE", KFORTH_IMAGE);
+  save_c_define(f, "KFORTH_SAVE_C", KFORTH_SAVE_C);
+  save_c_define(f, "KFORTH_PROFILE", KFORTH_PROFILE);
+  save_c_define(f, "KFORTH_JIT", KFORTH_JIT);
+  save_c_define(f, "KFORTH_TASKS", KFORTH_TASKS);
+  save_c_define(f, "KFORTH_TASKS_MAX", KFORTH_TASKS_MAX);
+  save_c_define(f, "KFORTH_TASK_STACK", KFORTH_TASK_STACK);
+  save_c_define(f, "KFORTH_TASK_USER", KFORTH_TASK_USER);
+  save_c_define(f, "KFORTH_FILES", KFORTH_FILES);
+  save_c_define(f, "KFORTH_FILES_MAX", KFORTH_FILES_MAX);
+  save_c_define(f, "KFORTH_FILE_BUF", KFORTH_FILE_BUF);
+  fprintf(f, "#define KFORTH_APP 1\n#include \"kforth.c\"\n\n");
+
+  for(ucell a=0; a<here; a++) if(has_fn[a]) fprintf(f, "static void app_%u(void);\n", a);
+  for(ucell a=0; a<here; a++){
+    if(!has_fn[a]) continue;
+    memset(mark, 0, here - a);
+    (void)body_reach(a, here - a, mark);
+    save_c_body(f, a, mark, has_fn);
+  }
+
+  save_c_array(f, "static const cell app_code", vm->code_mem, here);
+  save_c_array(f, "static const cell app_data", vm->data_mem, vm->here_data);
+  fprintf(f, "\nstatic const AppWord app_words[] = {\n");
+  for(int wi=core_dict_n; wi<vm->dict_n; wi++){
+    const Word *w = &vm->dict[wi];
+    fprintf(f, "  { %u, %u, %u, %u, %u, ", w->cfa, w->pfa, w->does_ip, w->immediate, w->noinline);
+    if(save_c_entry(wi, &e) && has_fn[e]) fprintf(f, "app_%u },\n", e);
+    else fprintf(f, "NULL },\n");
+  }
+  fprintf(f, "  { 0, 0, 0, 0, 0, NULL }\n};\n");
+  fprintf(f, "\nstatic const AppImage app_image = {\n  0x%xu, %u, %u, %d, %d, %d, %d, %d,\n"
+             "  app_code, app_data, app_words\n};\n", image_build_id, here, vm->here_data,
+             core_dict_n, vm->dict_n, vm->latest, vm->last_created, entry);
+  fprintf(f, "\n#ifndef KFORTH_NO_MAIN\nint main(void){\n  atexit(mf_flush);\n  return kforth_run_app();\n}\n#endif\n");
+
+  int ok = !ferror(f);
+  if(fclose(f) != 0) ok = 0;
+  free(has_fn);
+  free(mark);
+  if(!ok){ runtime_recover("SAVE-C write failed"); }
+}
+#endif
 
 /* ===== init core ===== */
 static void init_core(void){
   init_data_layout();
+  dict_hash_init();
 
   XT_EXIT    = def_prim("EXIT",    p_EXIT,    0);
   XT_LIT     = def_prim("LIT",     p_LIT,     0);
+  WI_LIT = vm->latest;   /* kept by index, not looked up: a SAVE-C program has no names */
   XT_BRANCH  = def_prim("BRANCH",  p_BRANCH,  0);
   XT_0BRANCH = def_prim("0BRANCH", p_0BRANCH, 0);
 
@@ -1065,38 +4673,60 @@ static void init_core(void){
   XT_DOVAR   = def_prim("DOVAR",   p_DOVAR,   0);
   XT_DODOES  = def_prim("DODOES",  p_DODOES,  0);
 
-  def_prim("DROP", p_DROP, 0);
-  def_prim("DUP",  p_DUP,  0);
-  def_prim("SWAP", p_SWAP, 0);
-  def_prim("OVER", p_OVER, 0);
+  XT_DROP = def_prim("DROP", p_DROP, 0);
+  XT_DUP = def_prim("DUP",  p_DUP,  0);
+  XT_SWAP = def_prim("SWAP", p_SWAP, 0);
+  XT_OVER = def_prim("OVER", p_OVER, 0);
 
-  def_prim("+",   p_ADD, 0);
-  def_prim("-",   p_SUB, 0);
+  XT_ADD = def_prim("+",   p_ADD, 0);
+  XT_SUB = def_prim("-",   p_SUB, 0);
   def_prim("*",   p_MUL, 0);
-  def_prim("AND", p_AND, 0);
-  def_prim("OR",  p_OR,  0);
-  def_prim("XOR", p_XOR, 0);
-  def_prim("0=",  p_ZEQ, 0);
-  def_prim("0<",  p_0LT, 0);
-
-  def_prim("@",  p_FETCH, 0);
-  def_prim("!",  p_STORE, 0);
+  XT_AND = def_prim("AND", p_AND, 0);
+  XT_OR  = def_prim("OR",  p_OR,  0);
+  XT_XOR = def_prim("XOR", p_XOR, 0);
+  XT_ZEQ = def_prim("0=",  p_ZEQ, 0);
+  XT_0LT = def_prim("0<",  p_0LT, 0);
+
+  XT_FETCH = def_prim("@",  p_FETCH, 0);
+  XT_STORE = def_prim("!",  p_STORE, 0);
   def_prim("C@", p_CAT,   0);
   def_prim("C!", p_CSTORE,0);
+  def_prim("W@", p_WFETCH, 0);
+  def_prim("W!", p_WSTORE, 0);
+  def_prim("L@", p_LFETCH, 0);
+  def_prim("L!", p_LSTORE, 0);
+  def_prim("CELL>BYTE", p_CELLTOBYTE, 0);
+  def_prim("BYTE>CELL", p_BYTETOCELL, 0);
+
+  def_prim("MOVE",    p_MOVE,    0);
+  def_prim("CMOVE",   p_CMOVE,   0);
+  def_prim("CMOVE>",  p_CMOVEUP, 0);
+  def_prim("FILL",    p_FILL,    0);
+  def_prim("ERASE",   p_ERASE,   0);
+  def_prim("COMPARE", p_COMPARE, 0);
+  def_prim("SEARCH",  p_SEARCH,  0);
 
-  def_prim(">R", p_TOR,   0);
-  def_prim("R>", p_RFROM, 0);
-  def_prim("R@", p_RAT,   0);
+  XT_TOR   = def_prim(">R", p_TOR,   0);
+  XT_RFROM = def_prim("R>", p_RFROM, 0);
+  XT_RAT   = def_prim("R@", p_RAT,   0);
 
   XT_DO    = def_prim("DO",    p_DO,    1);
   XT_LOOP  = def_prim("LOOP",  p_LOOP,  1);
   XT_PLOOP = def_prim("+LOOP", p_PLOOP, 1);
-  def_prim("I",     p_I,     0);
-  def_prim("J",     p_J,     0);
-  def_prim("UNLOOP",p_UNLOOP,0);
+  XT_I      = def_prim("I",     p_I,     0);
+  XT_J      = def_prim("J",     p_J,     0);
+  XT_UNLOOP = def_prim("UNLOOP",p_UNLOOP,0);
+  def_prim("?DO",   p_QDO,   1);
+  def_prim("LEAVE", p_LEAVE, 1);
+  XT_XQDO   = def_prim("(?DO)",   p_XQDO,   0);
+  XT_XLEAVE = def_prim("(LEAVE)", p_XLEAVE, 0);
 
   def_prim("HERE",  p_HERE,  0);
   def_prim("ALLOT", p_ALLOT, 0);
+  def_prim("ALLOCATE",   p_ALLOCATE,  0);
+  def_prim("FREE",       p_FREE,      0);
+  def_prim("RESIZE",     p_RESIZE,    0);
+  def_prim("HEAP-STATS", p_HEAPSTATS, 0);
   def_prim(",",     p_COMMA, 0);
 
   def_prim("HEREC", p_HEREC,     0);
@@ -1105,24 +4735,66 @@ static void init_core(void){
   def_prim(",C",    p_CCOMMA,    0);
 
   def_prim("EMIT", p_EMIT, 0);
+#if KFORTH_TASKS
+  XT_KEY = def_prim("KEY",  p_KEY,  0);
+#else
   def_prim("KEY",  p_KEY,  0);
+#endif
   def_prim(".",    p_DOT,  0);
   def_prim("IO@",  p_IOAT, 0);
   def_prim("IO!",  p_IOPUT, 0);
   def_prim("IOCTL",p_IOCTL, 0);
+  def_prim("IO-OPEN",     p_IOOPEN,     0);
+  def_prim("IO-CLOSE",    p_IOCLOSE,    0);
+  def_prim("READ-BLOCK",  p_READBLOCK,  0);
+  def_prim("WRITE-BLOCK", p_WRITEBLOCK, 0);
+#if KFORTH_TASKS
+  XT_IOWAIT = def_prim("IO-WAIT", p_IOWAIT, 0);
+#else
+  def_prim("IO-WAIT",     p_IOWAIT,     0);
+#endif
+#if KFORTH_FILES
+  def_prim("R/O", p_RO,  0);
+  def_prim("W/O", p_WO,  0);
+  def_prim("R/W", p_RW,  0);
+  def_prim("BIN", p_BIN, 0);
+  def_prim("OPEN-FILE",       p_OPENFILE,       0);
+  def_prim("CREATE-FILE",     p_CREATEFILE,     0);
+  def_prim("CLOSE-FILE",      p_CLOSEFILE,      0);
+  def_prim("READ-FILE",       p_READFILE,       0);
+  def_prim("READ-LINE",       p_READLINE,       0);
+  def_prim("WRITE-FILE",      p_WRITEFILE,      0);
+  def_prim("WRITE-LINE",      p_WRITELINE,      0);
+  def_prim("FILE-SIZE",       p_FILESIZE,       0);
+  def_prim("FILE-POSITION",   p_FILEPOSITION,   0);
+  def_prim("REPOSITION-FILE", p_REPOSITIONFILE, 0);
+  def_prim("MAP-FILE",        p_MAPFILE,        0);
+#endif
+#if KFORTH_TASKS
+  def_prim("PAUSE", p_PAUSE, 0);
+  def_prim("STOP",  p_STOP,  0);
+  def_prim("MS",    p_MS,    0);
+  def_text("TASK",  p_TASK,  0);
+  XT_ACTIVATE = def_prim("ACTIVATE", p_ACTIVATE, 0);
+  def_text("USER",  p_USER,  0);
+  XT_DOUSER = def_prim("DOUSER", p_DOUSER, 0);
+#endif
   def_prim("TYPE", p_TYPEP, 0);
+  WI_TYPE = vm->latest;
   def_prim("PROMPT-ON", p_PROMPTON, 0);
   def_prim("PROMPT-OFF", p_PROMPTOFF, 0);
   def_prim("BYE", p_BYE, 0);
+  def_prim("FLUSH", p_FLUSH, 0);
   def_prim("(ABORT\")", p_ABORTQ, 0);
+  WI_ABORTQ = vm->latest;
 
-  def_prim("S\"", p_SQUOTE, 1);
-  def_prim(".\"", p_DOTQUOTE, 1);
-  def_prim("ABORT\"", p_ABORTQUOTE, 1);
+  def_text("S\"", p_SQUOTE, 1);
+  def_text(".\"", p_DOTQUOTE, 1);
+  def_text("ABORT\"", p_ABORTQUOTE, 1);
 
-  def_prim("EXECUTE", p_EXECUTE, 0);
+  XT_EXECUTE = def_prim("EXECUTE", p_EXECUTE, 0);
 
-  def_prim("(", p_PAREN_COMMENT, 1);
+  def_text("(", p_PAREN_COMMENT, 1);
 
   /* self-host REPL primitives */
   def_prim("STATE",  p_STATE,  0);
@@ -1133,11 +4805,16 @@ static void init_core(void){
   def_prim("SOURCE", p_SOURCE, 0);
   def_prim("REFILL", p_REFILL, 0);
   def_prim("PARSE",  p_PARSE,  0);
-  def_prim("FIND",   p_FIND,   0);
-  def_prim("'",      p_TICK,   0);
-  def_prim("[']",    p_BRACKTICK, 1);
-  def_prim("POSTPONE", p_POSTPONE, 1);
+  def_text("FIND",   p_FIND,   0);
+  def_text("'",      p_TICK,   0);
+  def_text("[']",    p_BRACKTICK, 1);
+  def_text("POSTPONE", p_POSTPONE, 1);
   XT_XPOSTPONE = def_prim("(POSTPONE)", p_XPOSTPONE, 0);
+  def_text("[IF]",      p_BRACKIF,   1);
+  def_text("[ELSE]",    p_BRACKELSE, 1);
+  def_text("[THEN]",    p_BRACKTHEN, 1);
+  def_text("[DEFINED]", p_DEFINED,   1);
+  def_text("[UNDEFINED]", p_UNDEFINED, 1);
   def_prim("[",      p_LBRACK, 1);
   def_prim("]",      p_RBRACK, 1);
   def_prim(">NUMBER",p_TONUMBER,0);
@@ -1146,48 +4823,128 @@ static void init_core(void){
 
   /* additions: division/shift/debug */
   def_prim("/MOD",   p_DIVMOD, 0);
-  def_prim("LSHIFT", p_LSHIFT, 0);
-  def_prim("RSHIFT", p_RSHIFT, 0);
+  XT_LSHIFT = def_prim("LSHIFT", p_LSHIFT, 0);
+  XT_RSHIFT = def_prim("RSHIFT", p_RSHIFT, 0);
   def_prim("DEPTH",  p_DEPTH,  0);
   def_prim(".S",     p_DOTS,   0);
-  def_prim("WORDS",  p_WORDS,  0);
+  def_text("WORDS",  p_WORDS,  0);
 
   /* definers for bootstrap-loading */
-  def_prim(":",         p_COLON,     1);
-  def_prim(";",         p_SEMI,      1);
+  def_text(":",         p_COLON,     1);
+  def_text(";",         p_SEMI,      1);
   def_prim("IMMEDIATE", p_IMMEDIATE, 1);
-  def_prim("CREATE",    p_CREATE,    0);
-  def_prim("DOES>",     p_DOES,      1);
+  def_text("CREATE",    p_CREATE,    0);
+  def_text("DOES>",     p_DOES,      1);
   XT_XDOES = def_prim("(DOES>)", p_XDOES, 0);
 
-  WI_LIT = find_word_cstr("LIT");
-  WI_TYPE = find_word_cstr("TYPE");
-  WI_ABORTQ = find_word_cstr("(ABORT\")");
+  XT_2DUP       = def_prim("2DUP",      p_2DUP,       0);
+  def_text("SEE", p_SEE, 0);
+
+  /* superinstructions */
+  XT_LITADD     = def_prim("LIT+",      p_LITADD,     0);
+  XT_LITAND     = def_prim("LITAND",    p_LITAND,     0);
+  XT_LITLSHIFT  = def_prim("LITLSHIFT", p_LITLSHIFT,  0);
+  XT_LITRSHIFT  = def_prim("LITRSHIFT", p_LITRSHIFT,  0);
+  XT_LITFETCH   = def_prim("LIT@",      p_LITFETCH,   0);
+  XT_LITSTORE   = def_prim("LIT!",      p_LITSTORE,   0);
+  XT_DUP0BRANCH = def_prim("DUP0BRANCH",p_DUP0BRANCH, 0);
+  XT_ZEQ0BRANCH = def_prim("0=0BRANCH", p_ZEQ0BRANCH, 0);
+  XT_TAIL       = def_prim("(TAIL)",    p_TAIL,       0);
+  XT_IADD       = def_prim("I+",        p_IADD,       0);
+  XT_IADDFETCH  = def_prim("I+@",       p_IADDFETCH,  0);
+
+#if KFORTH_NATIVE_FLOAT
+  def_prim("S>F",      p_STOF,    0);
+  def_prim("F>S",      p_FTOS,    0);
+  def_prim("FSCALE2",  p_FSCALE2, 0);
+  def_prim("Q16.16>F", p_QTOF,    0);
+  def_prim("F>Q16.16", p_FTOQ,    0);
+  def_prim("F=",       p_FEQ,     0);
+  def_prim("F<",       p_FLT,     0);
+  def_prim("F<=",      p_FLE,     0);
+  def_prim("FADD",     p_FADD,    0);
+  def_prim("FSUB",     p_FSUB,    0);
+  def_prim("FMUL",     p_FMUL,    0);
+  def_prim("FDIV",     p_FDIV,    0);
+#endif
+
+#if KFORTH_INLINE_CELLS
+  def_prim("NOINLINE",   p_NOINLINE,  1);
+  def_prim("INLINE-ON",  p_INLINEON,  0);
+  def_prim("INLINE-OFF", p_INLINEOFF, 0);
+#endif
+
+#if KFORTH_IMAGE
+  def_text("SAVE-IMAGE", p_SAVEIMAGE, 0);
+#endif
+#if KFORTH_SAVE_C
+  def_text("SAVE-C", p_SAVEC, 0);
+#endif
+#if KFORTH_PROFILE
+  def_prim("PROFILE-ON",     p_PROFILEON,     0);
+  def_prim("PROFILE-OFF",    p_PROFILEOFF,    0);
+  def_prim("PROFILE-RESET",  p_PROFILERESET,  0);
+  def_prim("PROFILE-REPORT", p_PROFILEREPORT, 0);
+#endif
+#if KFORTH_JIT
+  def_prim("JIT-ON",  p_JITON,  0);
+  def_prim("JIT-OFF", p_JITOFF, 0);
+#endif
+
+#if KFORTH_IMAGE || KFORTH_SAVE_C || KFORTH_APP
+  image_build_id = core_build_id();
+#endif
+#if KFORTH_SAVE_C && !KFORTH_APP
+  core_dict_n = vm->dict_n;
+#endif
 }
 
 /* ===== C outer interpreter: stdin-only ===== */
+/*
+  Run a colon/DOES> word to completion. The nested run_thread() stops when
+  the word returns to the RS depth it was entered at, so this also works
+  from inside a running thread (e.g. (POSTPONE) of an immediate word).
+*/
 static void execute_wi(int wi){
-  Word *w = &dict[wi];
+  Word *w = &vm->dict[wi];
   if(w->cfa == XT_DOCOL || w->cfa == XT_DODOES){
-    ucell saved_ip = ip;
-    ip = 0;
-    exec_word(wi);
-    run_thread();
-    ip = saved_ip;
+    ucell saved_ip = vm->ip;
+    int saved_base = vm->rs_base;
+    int saved_running = vm->running;
+    vm->rs_base = vm->rsp;
+    vm->ip = 0;
+    vm->running = 1;
+    exec_word(wi);   /* a SAVE-C body has already run here */
+#if KFORTH_JIT
+    jit_entry f = jit_lookup(wi);
+    if(f){
+      vm->jit_active++;
+      f(vm);
+      vm->jit_active--;
+    }
+#endif
+    if(vm->running) run_thread();
+    if(vm->rsp == vm->rs_base) vm->running = saved_running; /* else ABORTed */
+    vm->rs_base = saved_base;
+    vm->ip = saved_ip;
   }else{
+#if KFORTH_PROFILE
+    if(vm->prof_on) prof_cell(wi);
+#endif
     exec_word(wi);
   }
 }
 
-static void interpret_token(const char *t){
-  int wi = find_word_cstr(t);
+#if !KFORTH_APP
+static void interpret_token(const char *t, size_t len){
+  int wi = find_word_n(t, len);
   cell n;
 
-  compiling = (data_mem[A_STATE] != 0);
+  vm->compiling = (vm->data_mem[A_STATE] != 0);
 
   if(wi >= 0){
-    Word *w = &dict[wi];
-    if(compiling && !w->immediate){
+    Word *w = &vm->dict[wi];
+    if(vm->compiling && !w->immediate){
       compile_wordtok(wi);
     }else{
       execute_wi(wi);
@@ -1195,10 +4952,14 @@ static void interpret_token(const char *t){
     return;
   }
 
-  if(parse_number_c(t, &n)){
-    if(compiling){
+  char s[128];
+  if(len >= sizeof(s)) len = sizeof(s) - 1;
+  memcpy(s, t, len);
+  s[len] = 0;
+  if(parse_number_c(s, &n)){
+    if(vm->compiling){
       int w_lit = find_word_cstr("LIT");
-      if(w_lit < 0){ out_err("no LIT"); exit(1); }
+      if(w_lit < 0){ out_err("no LIT"); vm_exit(1); }
       compile_wordtok(w_lit);
       ccomma(n);
     }else{
@@ -1208,44 +4969,422 @@ static void interpret_token(const char *t){
   }
 
   out_str("? ");
-  out_str(t);
+  out_str(s);
   out_nl();
   p_ABORT();
 }
 
-int kforth_run(void){
-  init_core();
+/* outer interpreter over the current VM's input until EOF, BYE or a fatal error */
+static int vm_interpret(void){
+  if(setjmp(vm->exit_env) != 0){
+    vm->exit_active = 0;
+    vm->recover_active = 0;
+    vm->dsp = 0;
+    vm->rsp = 0;
+    vm->running = 0;
+    vm->rs_base = 0;
+    vm->compiling = 0;
+    vm->current_def = -1;
+#if KFORTH_JIT
+    vm->jit_active = 0;
+#endif
+    vm->data_mem[A_STATE] = 0;
+    return vm->exit_status;
+  }
+  vm->exit_active = 1;
 
-  char tok[128];
-  while(next_token(tok, sizeof(tok))){
-    if(setjmp(recover_env) == 0){
-      recover_active = 1;
-      recover_requested = 0;
-      interpret_token(tok);
-      recover_active = 0;
-      if(prompt_mode && token_end_delim == '\n'){
+  const char *tok;
+  size_t tok_n;
+  while(next_token_ref(&tok, &tok_n)){
+    if(setjmp(vm->recover_env) == 0){
+      vm->recover_active = 1;
+      vm->recover_requested = 0;
+      interpret_token(tok, tok_n);
+      vm->recover_active = 0;
+      if(vm->prompt_mode && vm->token_end_delim == '\n'){
         out_nl();
         out_str("ok ");
+        vm_flush();
       }
     }else{
-      recover_active = 0;
-      if(recover_requested){
-        if(token_end_delim != '\n' && token_end_delim != '\r' && token_end_delim >= 0){
+      vm->recover_active = 0;
+      if(vm->recover_requested){
+        if(vm->token_end_delim != '\n' && vm->token_end_delim != '\r' && vm->token_end_delim >= 0){
           discard_to_eol();
         }
-        if(prompt_mode){
+        if(vm->prompt_mode){
           out_nl();
           out_str("ok ");
+          vm_flush();
         }
-        recover_requested = 0;
+        vm->recover_requested = 0;
       }
     }
   }
+  vm_flush();
+  vm->exit_active = 0;
+  return 0;
+}
+#endif
+
+/* ===== VM lifecycle ===== */
+static void vm_clear(kf_vm *v){
+  v->DS = v->DS_mem + 1;
+  v->code_max = lim_code;
+  v->data_max = lim_data;
+  v->dict_max = lim_dict;
+  v->latest = -1;
+  v->last_created = -1;
+  v->current_wi = -1;
+  v->current_def = -1;
+  v->leave_link = -2;
+  v->inline_on = 1;
+  v->token_end_delim = '\n';
+#if KFORTH_TASKS
+  v->task_cur = -1;
+  v->task_up = A_USER;
+#endif
+#if KFORTH_JIT
+  v->jit_on = !KFORTH_APP;
+#endif
+#if KFORTH_PROFILE
+  v->prof_n = 1;
+  v->prof_node[0] = (ProfNode){ -1, -1, 0, 0 };
+#endif
+}
+
+/* the first core also fixes the shared primitive table and engine dispatch */
+static void vm_build_core(void){
+  init_core();
+#if KFORTH_DIRECT_THREADED
+  engine_setup_only = 1;
+  run_thread();
+  engine_setup_only = 0;
+#endif
+}
+
+#if KFORTH_MULTI_VM
+static kf_vm *core_vm;   /* bare init_core() dictionary, copied into new VMs */
+
+/* zeroed VM; on Linux only reserved, pages are committed as they are touched */
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+static kf_vm *vm_alloc(void){
+#if defined(__linux__) && defined(MAP_NORESERVE)
+  void *p = mmap(NULL, sizeof(kf_vm), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return p == MAP_FAILED ? NULL : (kf_vm *)p;
+#else
+  return (kf_vm *)calloc(1, sizeof(kf_vm));
+#endif
+}
+static void vm_free(kf_vm *v){
+#if defined(__linux__) && defined(MAP_NORESERVE)
+  munmap(v, sizeof(kf_vm));
+#else
+  free(v);
+#endif
+}
+
+/* copy the dictionary and memory in use; stacks and I/O stay empty */
+static void vm_copy(kf_vm *d, const kf_vm *s){
+  memcpy(d->code_mem, s->code_mem, (size_t)s->here_code * sizeof(cell));
+  memcpy(d->data_mem, s->data_mem, (size_t)s->here_data * sizeof(cell));
+  memcpy(d->dict, s->dict, (size_t)s->dict_n * sizeof(Word));
+  memcpy(d->dict_hash, s->dict_hash, sizeof(d->dict_hash));
+  d->here_code = s->here_code;
+  d->here_data = s->here_data;
+  d->dict_n = s->dict_n;
+  d->latest = s->latest;
+  d->last_created = s->last_created;
+  d->inline_on = s->inline_on;
+  d->prompt_mode = s->prompt_mode;
+  d->data_mem[A_STATE] = 0;
+  d->data_mem[A_IN] = 0;
+  d->data_mem[A_NTIB] = 0;
+}
+
+/* the bare core, built on first use with the full regions */
+static const kf_vm *core_get(void){
+  if(!core_vm){
+    core_vm = vm_alloc();
+    if(!core_vm) return NULL;
+    vm_clear(core_vm);
+    core_vm->code_max = MEM_CODE_CELLS;
+    core_vm->data_max = DATA_TOP;
+    core_vm->dict_max = DICT_MAX;
+    kf_vm *saved = vm;
+    vm = core_vm;
+    vm_build_core();
+    vm = saved;
+  }
+  return core_vm;
+}
+
+kf_vm *kf_vm_create(const kf_vm *tmpl){
+  if(!tmpl && !(tmpl = core_get())) return NULL;
+  kf_vm *v = vm_alloc();
+  if(!v) return NULL;
+  vm_clear(v);
+  vm_copy(v, tmpl);
+  return v;
+}
+
+void kf_vm_destroy(kf_vm *v){
+#if KFORTH_FILES
+  files_close(v);
+#endif
+#if KFORTH_JIT
+  if(v->jit_mem) munmap(v->jit_mem, JIT_ARENA);
+#endif
+  vm_free(v);
+}
+
+void kf_vm_set_output(kf_vm *v, kf_out_fn fn, void *ctx){
+  v->out_fn = fn;
+  v->out_ctx = ctx;
+  v->out_n = 0;
+}
+
+#if KFORTH_IMAGE && !KFORTH_APP
+int kf_vm_load_image(kf_vm *v, const char *path){
+  kf_vm *saved = vm;
+  vm = v;
+  int ok = load_image(path);
+  vm_flush();
+  vm = saved;
+  return ok;
+}
+#endif
+
+#if !KFORTH_APP   /* the text interpreter */
+int kf_vm_run(kf_vm *v){
+  kf_vm *saved = vm;
+  vm = v;
+  v->src = v->src_end = NULL;
+  int rc = vm_interpret();
+  vm = saved;
+  return rc;
+}
+
+int kf_vm_eval(kf_vm *v, const char *text, size_t len){
+  kf_vm *saved = vm;
+  vm = v;
+  v->src = (const uint8_t *)(text ? text : "");
+  v->src_end = v->src + (text ? len : 0);
+  int rc = vm_interpret();
+  v->src = v->src_end = NULL;
+  vm = saved;
+  return rc;
+}
+#endif
+
+uint64_t kf_vm_cells_run(const kf_vm *v){
+#if KFORTH_COUNT_CELLS
+  return v->cells_run;
+#else
+  (void)v;
   return 0;
+#endif
+}
+#endif
+
+#if !KFORTH_APP
+#if KFORTH_PROFILE
+static const char *prof_out;   /* --profile / KFORTH_PROFILE_OUT */
+
+/* write the folded-stacks file for the run that just ended */
+static void prof_finish(kf_vm *v){
+  if(!prof_out) return;
+#if KFORTH_MULTI_VM
+  kf_vm *saved = vm;
+  vm = v;
+#else
+  (void)v;
+#endif
+  if(!prof_dump(prof_out)){ out_err("cannot write profile"); vm_flush(); }
+#if KFORTH_MULTI_VM
+  vm = saved;
+#endif
+}
+#define PROF_START(v) ((v)->prof_on = prof_out != NULL)
+#define PROF_FINISH(v) prof_finish(v)
+#else
+#define PROF_START(v) ((void)0)
+#define PROF_FINISH(v) ((void)0)
+#endif
+
+int kforth_run_image(const char *image_path){
+#if KFORTH_MULTI_VM
+  kf_vm *v = kf_vm_create(NULL);
+  if(!v){ mf_write((const uint8_t *)"? no memory\n", 12); mf_flush(); return 1; }
+  int rc = 1;
+#if KFORTH_IMAGE
+  if(!image_path || kf_vm_load_image(v, image_path)){
+#else
+  if(image_path){ mf_write((const uint8_t *)"? no image support\n", 19); mf_flush(); }
+  else{
+#endif
+    PROF_START(v);
+    rc = kf_vm_run(v);
+    PROF_FINISH(v);
+  }
+  kf_vm_destroy(v);
+  return rc;
+#else
+  if(!vm->dict_n){ vm_clear(vm); vm_build_core(); }   /* main may have built it already */
+  vm->code_max = lim_code;
+  vm->data_max = lim_data;
+  vm->dict_max = lim_dict;
+  if(image_path){
+#if KFORTH_IMAGE
+    if(!load_image(image_path)){ vm_flush(); return 1; }
+#else
+    out_err("no image support");
+    vm_flush();
+    return 1;
+#endif
+  }
+  PROF_START(vm);
+  int rc = vm_interpret();
+  PROF_FINISH(vm);
+  return rc;
+#endif
+}
+
+int kforth_run(void){
+  return kforth_run_image(NULL);
 }
+#endif
 
-#ifndef KFORTH_NO_MAIN
-int main(void){
-  return kforth_run();
+#if KFORTH_APP
+/* SAVE-C output: core words from init_core(), the rest from app_image, then run the entry word */
+int kforth_run_app(void){
+#if KFORTH_MULTI_VM
+  kf_vm *v = kf_vm_create(NULL);
+  if(!v){ mf_write((const uint8_t *)"? no memory\n", 12); mf_flush(); return 1; }
+  vm = v;
+#else
+  vm_clear(vm);
+  vm_build_core();
+#endif
+  const AppImage *img = &app_image;
+  int rc = 1;
+  if(img->build_id != image_build_id || img->core_n != vm->dict_n){
+    out_err("app from another build");
+    vm_flush();
+  }else{
+    memcpy(vm->code_mem, img->code, (size_t)img->here_code * sizeof(cell));
+    memcpy(vm->data_mem, img->data, (size_t)img->here_data * sizeof(cell));
+    for(int wi=img->core_n; wi<img->dict_n; wi++){   /* names are not saved */
+      const AppWord *a = &img->words[wi - img->core_n];
+      Word *w = &vm->dict[wi];
+      memset(w, 0, sizeof(*w));
+      w->link = wi - 1;
+      w->hnext = -1;
+      w->cfa = a->cfa;
+      w->pfa = a->pfa;
+      w->does_ip = a->does_ip;
+      w->immediate = a->immediate;
+      w->noinline = a->noinline;
+    }
+    vm->here_code = img->here_code;
+    vm->here_data = img->here_data;
+    vm->dict_n = img->dict_n;
+    vm->latest = img->latest;
+    vm->last_created = img->last_created;
+    vm->data_mem[A_STATE] = 0;
+    vm->data_mem[A_IN] = 0;
+    vm->data_mem[A_NTIB] = 0;
+    if(setjmp(vm->exit_env) == 0){
+      vm->exit_active = 1;
+      if(setjmp(vm->recover_env) == 0){
+        vm->recover_active = 1;
+        execute_wi(img->entry);
+        rc = 0;
+      }
+    }else{
+      rc = vm->exit_status;
+    }
+    vm->exit_active = 0;
+    vm->recover_active = 0;
+    vm_flush();
+  }
+#if KFORTH_MULTI_VM
+  vm = NULL;
+  kf_vm_destroy(v);
+#endif
+  return rc;
+}
+#endif
+
+#if !defined(KFORTH_NO_MAIN) && !KFORTH_APP
+/* the bare core, whose size is the floor for --code-cells etc. */
+static const kf_vm *core_ready(void){
+#if KFORTH_MULTI_VM
+  return core_get();
+#else
+  if(!vm->dict_n){ vm_clear(vm); vm_build_core(); }
+  return vm;
+#endif
+}
+
+/* --code-cells etc. (or KFORTH_CODE_CELLS etc.): store n in *lim if it is min..max */
+static int limit_opt(const char *name, const char *arg, long min, long max, long *lim){
+  char *end;
+  long n;
+  if(!arg || !*arg) return 1;
+  n = strtol(arg, &end, 10);
+  if(*end || n < min || n > max){
+    char msg[96];
+    int len = snprintf(msg, sizeof(msg), "kforth: %s must be %ld..%ld\n", name, min, max);
+    mf_write((const uint8_t *)msg, (size_t)len);
+    mf_flush();
+    return 0;
+  }
+  *lim = n;
+  return 1;
+}
+
+int main(int argc, char **argv){
+  const char *image = NULL;
+  const char *code_arg = getenv("KFORTH_CODE_CELLS");
+  const char *data_arg = getenv("KFORTH_DATA_CELLS");
+  const char *dict_arg = getenv("KFORTH_DICT_WORDS");
+  long code_n = MEM_CODE_CELLS, data_n = DATA_TOP, dict_n = DICT_MAX;
+#if KFORTH_PROFILE
+  prof_out = getenv("KFORTH_PROFILE_OUT");
+  if(prof_out && !*prof_out) prof_out = NULL;
+#endif
+  for(int i=1;i<argc;i+=2){
+    if(i + 1 < argc && strcmp(argv[i], "--image") == 0) image = argv[i+1];
+    else if(i + 1 < argc && strcmp(argv[i], "--code-cells") == 0) code_arg = argv[i+1];
+    else if(i + 1 < argc && strcmp(argv[i], "--data-cells") == 0) data_arg = argv[i+1];
+    else if(i + 1 < argc && strcmp(argv[i], "--dict-words") == 0) dict_arg = argv[i+1];
+#if KFORTH_PROFILE
+    else if(i + 1 < argc && strcmp(argv[i], "--profile") == 0) prof_out = argv[i+1];
+#endif
+    else{
+#if KFORTH_PROFILE
+      static const char usage[] = "usage: kforth [--image file] [--code-cells n] [--data-cells n] [--dict-words n] [--profile file]\n";
+#else
+      static const char usage[] = "usage: kforth [--image file] [--code-cells n] [--data-cells n] [--dict-words n]\n";
+#endif
+      mf_write((const uint8_t *)usage, sizeof(usage) - 1);
+      mf_flush();
+      return 2;
+    }
+  }
+  const kf_vm *core = core_ready();
+  if(!core){ mf_write((const uint8_t *)"? no memory\n", 12); mf_flush(); return 1; }
+  if(!limit_opt("--code-cells", code_arg, core->here_code ? (long)core->here_code : 1, MEM_CODE_CELLS, &code_n)) return 2;
+  if(!limit_opt("--data-cells", data_arg, (long)core->here_data, DATA_TOP, &data_n)) return 2;
+  if(!limit_opt("--dict-words", dict_arg, (long)core->dict_n, DICT_MAX, &dict_n)) return 2;
+  lim_code = (ucell)code_n;
+  lim_data = (ucell)data_n;
+  lim_dict = (int)dict_n;
+  atexit(mf_flush);   /* fatal errors exit() with output still buffered */
+  return kforth_run_image(image);
 }
 #endif
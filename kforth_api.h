@@ -1,7 +1,43 @@
 #ifndef KFORTH_API_H
 #define KFORTH_API_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 /* Run the interpreter loop until input EOF (or BYE/exit). */
 int kforth_run(void);
 
+/* Same, starting from a SAVE-IMAGE file instead of a bare core (NULL: none). */
+int kforth_run_image(const char *image_path);
+
+/* In a program generated by SAVE-C: run its saved entry word (no outer interpreter). */
+int kforth_run_app(void);
+
+/*
+  Independent interpreters (host builds, KFORTH_MULTI_VM).
+  Each kf_vm owns its memory, stacks and dictionary; only the primitive table
+  is shared. A VM may be run by any thread, but by one thread at a time.
+  The first kf_vm_create() builds the shared primitive table and must finish
+  before other threads create VMs. A template passed to kf_vm_create() is only
+  read, so many threads may clone one bootstrapped VM while it sits idle.
+  BYE and fatal errors end the current run/eval call instead of the process;
+  the return value is 0 at end of input or BYE, else the error status.
+  The terminal is one device per process: its input window and output buffer
+  are shared, so only one VM at a time may run with the terminal as its input
+  (kf_vm_run) or output (no kf_vm_set_output fn). VMs run from other threads
+  need their own sink and kf_vm_eval. Device handles (IO-OPEN) also belong
+  to the process: every VM sees the same handles, and a handle must not be
+  closed while another VM is using it.
+*/
+typedef struct kf_vm kf_vm;
+typedef void (*kf_out_fn)(void *ctx, const uint8_t *buf, size_t len);
+
+kf_vm *kf_vm_create(const kf_vm *tmpl);   /* NULL: bare core, else a copy of tmpl */
+void   kf_vm_destroy(kf_vm *vm);
+int    kf_vm_load_image(kf_vm *vm, const char *path);   /* 1 ok, 0 rejected */
+void   kf_vm_set_output(kf_vm *vm, kf_out_fn fn, void *ctx);   /* NULL fn: the shared terminal */
+int    kf_vm_run(kf_vm *vm);                               /* read the terminal */
+int    kf_vm_eval(kf_vm *vm, const char *src, size_t len); /* read src instead */
+uint64_t kf_vm_cells_run(const kf_vm *vm);   /* cells executed since create; 0 without KFORTH_COUNT_CELLS */
+
 #endif
@@ -7,7 +7,7 @@ extern "C" {
 #if defined(ARDUINO)
 /*
  * Handle map (minimal):
- *   0: Serial
+ *   0: Serial (READ-BLOCK/WRITE-BLOCK move whole buffers with readBytes/write)
  *
  * IOCTL request map for handle 0:
  *   0: available?    (x ignored) -> y=available bytes
@@ -62,4 +62,53 @@ int kf_io_ctl(int32_t h, int32_t req, int32_t x, int32_t *y){
       return 0;
   }
 }
+
+/* no file system: only handle 0 (Serial) can be read, written and waited on */
+int kf_io_open(const char *path, int32_t mode, int32_t *h){
+  (void)path;
+  (void)mode;
+  *h = 0;
+  return 0;
+}
+
+int kf_io_close(int32_t h){
+  (void)h;
+  return 0;
+}
+
+int kf_io_read(int32_t h, uint8_t *buf, int32_t len, int32_t *n){
+  *n = 0;
+  if(h != 0 || len < 0) return 0;
+  int32_t k = (int32_t)Serial.available();
+  if(k > len) k = len;
+  if(k > 0) *n = (int32_t)Serial.readBytes((char *)buf, (size_t)k);
+  return 1;
+}
+
+int kf_io_write(int32_t h, const uint8_t *buf, int32_t len, int32_t *n){
+  *n = 0;
+  if(h != 0 || len < 0) return 0;
+  *n = (int32_t)Serial.write(buf, (size_t)len);
+  return 1;
+}
+
+int kf_io_wait(uint32_t mask, int32_t timeout_ms, uint32_t *ready){
+  uint32_t t0 = millis();
+  *ready = 0;
+  if(!(mask & 1u)) return 1;
+  while(Serial.available() <= 0){
+    if(timeout_ms >= 0 && (uint32_t)(millis() - t0) >= (uint32_t)timeout_ms) return 1;
+    delay(1);
+  }
+  *ready = 1;
+  return 1;
+}
+
+uint32_t kf_ms(void){
+  return (uint32_t)millis();
+}
+
+void kf_idle(void){
+  delay(1);
+}
 #endif
@@ -5,14 +5,49 @@ extern "C" {
 }
 
 #if defined(ARDUINO)
-int mf_key(void) {
-  while (Serial.available() <= 0) {
-    delay(1);
+static uint8_t in_buf[64];
+static size_t in_pos = 0;
+static size_t in_len = 0;
+
+const uint8_t *mf_in_window(size_t *len) {
+  if (in_pos == in_len) {
+    while (Serial.available() <= 0) {
+      delay(1);
+    }
+    size_t avail = (size_t)Serial.available();
+    if (avail > sizeof(in_buf)) avail = sizeof(in_buf);
+    in_pos = 0;
+    in_len = Serial.readBytes(in_buf, avail);
   }
-  return Serial.read() & 0xFF;
+  *len = in_len - in_pos;
+  return in_buf + in_pos;
+}
+
+int mf_key_ready(void) {
+  return in_pos < in_len || Serial.available() > 0;
+}
+
+void mf_in_consume(size_t n) {
+  in_pos += n;
+}
+
+int mf_key(void) {
+  size_t n;
+  const uint8_t *p = mf_in_window(&n);
+  if (n == 0) return -1;
+  in_pos++;
+  return *p;
 }
 
 void mf_emit(uint8_t ch) {
   Serial.write(ch);
 }
+
+void mf_write(const uint8_t *buf, size_t len) {
+  Serial.write(buf, len);
+}
+
+void mf_flush(void) {
+  Serial.flush();
+}
 #endif
@@ -59,6 +59,8 @@ expect_contains "min normal bits and finite predicate" $'8388608 FHEX. 8388608 F
 expect_contains "subnormal bits are finite but unsupported in conversion" $'1 FHEX. 1 FFINITE? . 1 FNAN? . 1 FINF? .\nBYE\n' "00000001 -1 0 0 "
 expect_contains "subnormal conversion reports error" $'1 F>S\n1 2 + .\nBYE\n' "float subnormal unsupported"
 expect_contains "subnormal conversion recovers" $'1 F>S\n1 2 + .\nBYE\n' "3 "
+expect_contains "float overflow reports error" $'2139095039 DUP FMUL\n1 2 + .\nBYE\n' "float overflow"
+expect_contains "F>S overflow reports error" $'0 1325400064 F>S\n1 2 + .\nBYE\n' "F>S overflow"
 expect_contains "NaN comparisons false" $'FNAN FNAN F= . FNAN 1 S>F F< .\nBYE\n' "0 0 "
 expect_contains "FDIV zero and inf cases" $'1 S>F 0 S>F FDIV FINF? . 0 S>F 0 S>F FDIV FNAN? .\nBYE\n' "-1 -1 "
 expect_contains "FADD/FMUL special propagation" $'F+INF F-INF FADD FNAN? . F+INF 0 S>F FMUL FNAN? .\nBYE\n' "-1 -1 "
@@ -88,6 +88,25 @@ expect_not_contains() {
   rm -f "$out" "$err"
 }
 
+# same as expect_contains on stdout, with stdin redirected from a regular file
+expect_file_input_contains() {
+  local label="$1"
+  local payload="$2"
+  local needle="$3"
+  local in out err
+  in="$(mktemp)"
+  out="$(mktemp)"
+  err="$(mktemp)"
+  { cat bootstrap.fth; printf "%s" "$payload"; } >"$in"
+  ./build/kforth <"$in" >"$out" 2>"$err"
+  if grep -Fq -- "$needle" "$out"; then
+    report_pass "$label"
+  else
+    report_fail "$label" "$out" "$err" "expected '$needle' in out"
+  fi
+  rm -f "$in" "$out" "$err"
+}
+
 expect_fatal_contains() {
   local label="$1"
   local payload="$2"
@@ -169,11 +188,27 @@ core_suite() {
   expect_contains "nested J" $': JTEST 0 3 0 DO 5 8 5 DO J + LOOP LOOP ; JTEST .\n' out "11 "
   expect_contains "+LOOP step" $': STEP2 0 10 0 DO I + 2 +LOOP ; STEP2 .\n' out "20 "
   expect_contains "+LOOP negative step" $': DOWN 0 0 10 DO I + -2 +LOOP ; DOWN .\n' out "30 "
+  expect_contains "+LOOP -1 includes limit" $': DN 0 10 DO I . -1 +LOOP ; DN\n' out "10 9 8 7 6 5 4 3 2 1 0 "
+  expect_contains "+LOOP crosses wrap" $': WR 0 -2147483647 2147483646 DO 1+ 1 +LOOP ; WR .\n' out "3 "
+  expect_contains "?DO skips equal" $': QD 7 5 5 ?DO 1+ LOOP ; QD .\n' out "7 "
+  expect_contains "?DO runs unequal" $': QR 0 3 0 ?DO I + LOOP ; QR .\n' out "3 "
+  expect_contains "LEAVE" $': LV 10 0 DO I 3 = IF LEAVE THEN I . LOOP 77 . ; LV\n' out "0 1 2 77 "
+  expect_contains "LEAVE inner loop only" $': LN 3 0 DO 5 0 DO I J + . LEAVE LOOP LOOP ; LN\n' out "0 1 2 "
+  expect_contains "LEAVE in +LOOP and ?DO" $': LP 100 0 ?DO I 6 > IF LEAVE THEN I . 3 +LOOP ; LP\n' out "0 3 6 "
+  expect_contains "LEAVE outside DO" $': LO LEAVE ;\n' out "LEAVE outside DO"
+  expect_contains "fused I + @" $'CREATE AR 5 , 6 , 7 , : IA 0 3 0 DO AR I + @ + LOOP ; IA . SEE IA\n' out "18 "
+  if [[ "$PEEPHOLE" -eq 1 ]]; then
+    expect_contains "SEE shows I+@" $'CREATE AR 5 , 6 , 7 , : IA 0 3 0 DO AR I + @ + LOOP ; SEE IA\n' out "I+@"
+  fi
+  expect_contains "loop index across calls" $': SQ DUP * ; : LC 0 5 0 DO I SQ + I >R R> DROP LOOP ; LC .\n' out "30 "
 
   expect_contains "CREATE + @ !" $'CREATE T 0 , 123 T ! T @ .\n' out "123 "
   expect_contains "HERE @ !" $'HERE DUP 123 SWAP ! @ .\n' out "123 "
   expect_contains "HEREC CODE! CODE@" $'HEREC DUP 777 SWAP CODE! CODE@ .\n' out "777 "
   expect_contains "paren comment" $'( comment ) 4 5 + .\n' out "9 "
+  expect_contains "paren comment spans lines" $'( first\nsecond ) 4 5 + .\n' out "9 "
+  expect_contains "CRLF line endings" $'1 2 +\r\n. \r\n' out "3 "
+  expect_file_input_contains "file stdin" $'( a\nb ) S" x y" TYPE 2 3 * .\n' "x y6 "
   expect_contains "WORDS contains BYE" $'WORDS\n' out "BYE"
   expect_contains "EMIT" $'65 EMIT\n' out "A"
   expect_contains "KEY" $': KTEST KEY . ;\nKTEST\nZ\n' out "90 "
@@ -183,6 +218,9 @@ core_suite() {
 
   expect_contains "underflow recovery" $'.\n1 2 + .\n' out "? data stack underflow"
   expect_contains "underflow continues" $'.\n1 2 + .\n' out "3 "
+  expect_contains "underflow inside colon" $': UF DROP + ; UF\n1 2 + .\n' out "? data stack underflow"
+  expect_contains "overflow inside colon" $': OF 300 0 DO I LOOP ; OF\n1 2 + .\n' out "? data stack overflow"
+  expect_contains "overflow recovery continues" $': OF 300 0 DO I LOOP ; OF\n1 2 + .\n' out "3 "
   expect_contains "ABORT recovers" $'ABORT\n1 2 + .\n' out "3 "
   expect_contains "/MOD divide by zero recovery" $'10 0 /MOD\n1 2 + .\n' out "? /MOD divide by zero"
   expect_contains "/MOD divide by zero continues" $'10 0 /MOD\n1 2 + .\n' out "3 "
@@ -206,6 +244,17 @@ core_suite() {
 
   expect_contains "ALLOT moves HERE" $'HERE DUP 3 ALLOT HERE SWAP - .\n' out "3 "
   expect_contains "C! C@" $'HERE 1 ALLOT DUP 65 SWAP C! C@ .\n' out "65 "
+  expect_contains "L! L@ unaligned" $'CREATE B 4 ALLOT 1 B CELL>BYTE 1+ L! B CELL>BYTE 1+ L@ . B @ . B 1+ @ .\n' out "1 256 0 "
+  expect_contains "W! W@ C@" $'CREATE B 4 ALLOT 4660 B CELL>BYTE 3 + W! B CELL>BYTE 3 + W@ . B CELL>BYTE 3 + C@ .\n' out "4660 52 "
+  expect_contains "W! keeps low 16 bits" $'CREATE B 2 ALLOT 0 B ! 70000 B CELL>BYTE W! B @ .\n' out "4464 "
+  expect_contains "CELL>BYTE BYTE>CELL" $'7 CELL>BYTE . 30 BYTE>CELL .\n' out "28 7 "
+  expect_contains "MOVE overlapping" $'S" abcdef" OVER DUP 1+ 5 MOVE TYPE\n' out "aabcde"
+  expect_contains "CMOVE repeats pattern" $'S" abcdef" OVER DUP 1+ 5 CMOVE TYPE\n' out "aaaaaa"
+  expect_contains "CMOVE> overlapping" $'S" abcdef" OVER DUP 1+ SWAP 5 CMOVE> TYPE\n' out "ffffff"
+  expect_contains "FILL ERASE" $'HERE 4 * 2 ALLOT DUP 8 65 FILL DUP 2 + 3 ERASE DUP C@ . DUP 3 + C@ . 6 + C@ .\n' out "65 0 65 "
+  expect_contains "COMPARE" $'S" abc" S" abd" COMPARE . S" abc" S" abc" COMPARE . S" abcd" S" abc" COMPARE .\n' out "-1 0 1 "
+  expect_contains "SEARCH found" $'S" hello world" S" wor" SEARCH . . DROP\n' out "-1 5 "
+  expect_contains "SEARCH not found" $'S" hello" S" xyz" SEARCH . .\n' out "0 5 "
   expect_contains ",C stores to code" $'HEREC DUP >R 88 ,C R> CODE@ .\n' out "88 "
 
   expect_contains "DEPTH" $'DEPTH . 1 2 DEPTH .\n' out "0 2 "
@@ -215,6 +264,9 @@ core_suite() {
   expect_contains "FIND found" $': STAR 42 ; S" STAR" FIND . .\n' out "1 "
   expect_contains "FIND immediate flag" $': IMW 7 ; IMMEDIATE S" IMW" FIND . .\n' out "-1 "
   expect_contains "FIND missing" $'S" NOPE" FIND .\n' out "0 "
+  expect_contains "redefinition shadows" $': SHAD 1 ; : SHAD 2 ; SHAD .\n' out "2 "
+  expect_contains "FIND finds newest" $': SHAD 1 ; : SHAD 2 ; S" SHAD" FIND DROP EXECUTE .\n' out "2 "
+  expect_contains "FIND long name truncates" $': ABCDEFGHIJKLMNO 7 ; S" ABCDEFGHIJKLMNOXYZ" FIND DROP EXECUTE .\n' out "7 "
   expect_contains "['] + EXECUTE" $': STAR 42 ; : XTSTAR [\'] STAR ; XTSTAR EXECUTE .\n' out "42 "
 
   expect_contains "UNLOOP + EXIT" $': UTEST 0 5 0 DO I 2 = IF UNLOOP EXIT THEN 1 + LOOP ; UTEST .\n' out "2 "
@@ -304,6 +356,41 @@ bootstrap_behavior_suite() {
   expect_contains "PATCH" $'HEREC DUP >R 0 ,C 0 ,C R> PATCH CODE@ .\n' out "1 "
   expect_contains "AGAIN compile path" $': ATEST 123 EXIT BEGIN 1 AGAIN ; ATEST .\n' out "123 "
   expect_contains "WHILE REPEAT runtime" $'0 CSP ! : WREP 0 BEGIN DUP 3 < WHILE 1+ REPEAT ; WREP .\n' out "3 "
+  expect_contains "WHILE leaves stack clean" $': WCLEAN 0 BEGIN DUP 3 < WHILE 1+ REPEAT ; DEPTH 100 + .\n' out "100 "
+  expect_contains "WHILE inside DO" $': WDO 0 3 0 DO BEGIN DUP 2 < WHILE 1+ REPEAT LOOP ; WDO .\n' out "2 "
+  expect_contains "fused LIT ops" $': FL 3 + 10 - 255 AND 4 LSHIFT 2 RSHIFT ; 300 FL .\n' out "148 "
+  expect_contains "fused VARIABLE @ !" $'VARIABLE FV : FV+ FV @ 1+ FV ! ; 5 FV ! FV+ FV+ FV @ .\n' out "7 "
+  expect_contains "fused DUP IF / 0= IF" $': FB DUP IF 1 ELSE 2 THEN SWAP 0= IF 7 THEN ; 0 FB . . 5 FB .\n' out "7 2 1 "
+  expect_contains "fusion stops at branch target" $': FT 0 BEGIN 1 + DUP 3 = UNTIL ; FT .\n' out "3 "
+  expect_contains "2DUP primitive" $'1 2 2DUP .S\n' out "<4> 1 2 1 2 "
+  if [[ "$PEEPHOLE" -eq 1 ]]; then
+    expect_contains "SEE shows superinstructions" $': ST 1 + ; SEE ST\n' out "LIT+ 1"
+    expect_contains "SEE branch target" $': SB DUP IF 1 THEN ; SEE SB\n' out "DUP0BRANCH"
+  fi
+  expect_contains "inlined -ROT =" $': IR -ROT = ; 1 2 3 IR . .\n' out "0 3 "
+  if [[ "$PEEPHOLE" -eq 1 ]]; then
+    expect_contains "SEE shows inlined body" $': IB 1+ ; SEE IB\n' out "LIT+ 1"
+    expect_contains "CONSTANT child inlines" $'10 CONSTANT TEN : CT TEN ; SEE CT\n' out "LIT@"
+  fi
+  expect_contains "NOINLINE keeps call" $': SQ DUP * ; NOINLINE : NQ SQ ; SEE NQ\n' out " SQ"
+  expect_contains "INLINE-OFF keeps call" $'INLINE-OFF : IO 1+ ; SEE IO\n' out " 1+"
+  expect_contains "call to R> DROP word not inlined" $': SK R> DROP ; : SY SK 1 . ; : SZ SY 2 . ; SZ 3 .\n' out "2 3 "
+  expect_contains "redefinition inlines the new body" $': RD 1 ; : RD 2 ; : RC RD ; RC .\n' out "2 "
+  expect_contains "CODE! patched word not inlined" $'HEREC : PW 1 ; 2 OVER 1+ CODE! DROP : PC PW ; SEE PC PC .\n' out " PW"
+  if [[ "$PEEPHOLE" -eq 1 ]]; then
+    expect_contains "tail recursion keeps RS flat" $': CNT DUP 0= IF EXIT THEN 1- CNT ; 100000 CNT .\n' out "0 "
+    expect_contains "SEE shows tail call" $': TB DUP IF 1 THEN ; : TC 1 TB ; SEE TC\n' out "(TAIL) TB"
+  fi
+  expect_contains "R> DROP word not tail called" $': SKIP R> DROP ; : Y 1 . SKIP ; : Z Y 2 . ; Z 3 .\n' out "1 2 3 "
+  expect_not_contains "NOINLINE word not tail called" $': TB DUP IF 1 THEN ; NOINLINE : TN 1 TB ; SEE TN\n' out "(TAIL)"
+  expect_contains "tail call returns to caller" $': TB DUP IF 1 THEN ; : TA 5 TB ; : TD TA 7 ; TD . . .\n' out "7 1 5 "
+  expect_contains "tail call in DOES>" $': TB DUP IF 1 THEN ; : MK CREATE , DOES> @ TB ; 4 MK M4 M4 . .\n' out "1 4 "
+  expect_contains "CODE! splits tail call" $': TB DUP IF 1 THEN ; : TE 2 * ; HEREC : TA 5 TB ; \' TE SWAP 2 + CODE! TA .\n' out "10 "
+  expect_contains "[IF] true branch" $'1 [IF] 11 [ELSE] 22 [THEN] .\n' out "11 "
+  expect_contains "[IF] false branch" $'0 [IF] 11 [ELSE] 22 [THEN] .\n' out "22 "
+  expect_contains "[IF] nested skip" $'0 [IF] 1 [IF] 11 [THEN] 33 [ELSE] 44 [THEN] .\n' out "44 "
+  expect_contains "[IF] inside definition" $': CI [ 1 ] [IF] 5 [ELSE] 6 [THEN] ; CI .\n' out "5 "
+  expect_contains "[DEFINED] [UNDEFINED]" $'[DEFINED] DUP . [UNDEFINED] NOPE . [DEFINED] NOPE .\n' out "-1 -1 0 "
   expect_contains "LITERAL" $': LT [ 42 ] LITERAL ; LT .\n' out "42 "
   expect_contains "PARSE-NAME" $': PN PARSE-NAME NIP . ;\nPN ABC\n' out "3 "
   expect_contains "INTERPRET direct" $'INTERPRET\n' out "ok "
@@ -325,9 +412,23 @@ fatal_suite() {
   expect_fatal_contains "! bad address" $'0 -1 !\n' out "? ! bad -1"
   expect_fatal_contains "C@ bad address" $'-1 C@\n' out "? C@ bad -1"
   expect_fatal_contains "C! bad address" $'0 -1 C!\n' out "? C! bad -1"
+  expect_fatal_contains "W@ past the end" $'4194303 W@\n' out "? W@ bad 4194303"
+  expect_fatal_contains "L! bad address" $'0 -1 L!\n' out "? L! bad -1"
+  expect_fatal_contains "MOVE bad address" $'0 -1 4 MOVE\n' out "? MOVE bad -1"
+  expect_fatal_contains "TYPE bad address" $'-1 4 TYPE\n' out "? TYPE bad -1"
   expect_fatal_contains "CODE@ bad address" $'-1 CODE@\n' out "? CODE@ bad -1"
   expect_fatal_contains "CODE! bad address" $'0 -1 CODE!\n' out "? CODE! bad -1"
   expect_fatal_contains "ALLOT negative" $'-1 ALLOT\n' out "? ALLOT neg"
+  expect_contains "code full recovers" $': CFILL BEGIN 0 ,C AGAIN ; CFILL\n2 3 + .\n' out "? code full"
+  expect_contains "data full recovers" $': DFILL BEGIN 0 , AGAIN ; DFILL\n4 5 + .\n' out "ok 9 "
+  expect_contains "ALLOCATE FREE" $'3 ALLOCATE . DUP 42 SWAP ! DUP @ . FREE .\n' out "0 42 0 "
+  expect_contains "FREE twice fails" $'3 ALLOCATE DROP DUP FREE . FREE . 5 FREE .\n' out "0 -60 -60 "
+  expect_contains "small class reused" $'3 ALLOCATE DROP DUP FREE DROP 4 ALLOCATE DROP = .\n' out "-1 "
+  expect_contains "RESIZE grows in place" $'100 ALLOCATE DROP DUP 7 SWAP ! DUP 200 RESIZE . SWAP OVER = . @ .\n' out "0 -1 7 "
+  expect_contains "RESIZE moves and copies" $'5 ALLOCATE DROP 20 ALLOCATE DROP DROP DUP 9 SWAP ! 40 RESIZE . @ .\n' out "0 9 "
+  expect_contains "ALLOCATE too big" $'100000 ALLOCATE . . 1 1000000 RESIZE . .\n' out "-59 0 -61 1 "
+  expect_contains "small block takes the heap's tail" $'8185 ALLOCATE . CONSTANT BIG 2 ALLOCATE . CONSTANT SM SM FREE . BIG FREE . HEAP-STATS\n' out "0 0 0 0 heap 8192 used 0 peak 8192 free 8192 largest 8192"
+  expect_contains "large blocks coalesce" $'100 ALLOCATE DROP 100 ALLOCATE DROP SWAP FREE DROP FREE DROP HEAP-STATS\n' out "used 0 peak 204 free 8192 largest 8192 small-free 0 frag 0%"
   expect_fatal_contains "EXECUTE bad xt" $'9999 EXECUTE\n' out "? EXECUTE bad xt"
   expect_fatal_contains "R@ underflow fatal" $'R@\n' out "? R@ underflow"
   expect_fatal_contains "I underflow fatal" $'I\n' out "? I RS underflow"
@@ -336,22 +437,282 @@ fatal_suite() {
   expect_fatal_contains "(ABORT\") bad len fatal" $'1 0 -1 (ABORT")\n' out "? ABORT\" bad len"
 }
 
+# run payload on an image saved after bootstrap + setup
+expect_image_contains() {
+  local label="$1"
+  local img="$2"
+  local payload="$3"
+  local needle="$4"
+  local out err
+  out="$(mktemp)"
+  err="$(mktemp)"
+  set +e
+  printf "%s" "$payload" | ./build/kforth --image "$img" >"$out" 2>"$err"
+  set -e
+  if grep -Fq -- "$needle" "$out"; then
+    report_pass "$label"
+  else
+    report_fail "$label" "$out" "$err" "expected '$needle' in out"
+  fi
+  rm -f "$out" "$err"
+}
+
+image_suite() {
+  local img bad out err
+  img="$(mktemp)"
+  bad="$(mktemp)"
+  out="$(mktemp)"
+  err="$(mktemp)"
+  run_with_bootstrap $': SAVED 42 ;\nVARIABLE KEPT 7 KEPT !\n: GREET S" hi" TYPE ;\nS" '"$img"$'" SAVE-IMAGE BYE\n' "$out" "$err"
+  expect_image_contains "image restores words" "$img" $'SAVED . KEPT @ . GREET\n' "42 7 hi"
+  expect_image_contains "image restores floats" "$img" $'3 S>F 2 S>F FDIV F.\n' "1.5000"
+  expect_image_contains "image keeps compiling" "$img" $': SQ DUP * ; 9 SQ .\n' "81 "
+  expect_image_contains "image keeps prompt" "$img" $'1 .\n' "ok "
+  head -c 100 "$img" >"$bad"
+  expect_image_contains "truncated image rejected" "$bad" "" "? image corrupt"
+  expect_image_contains "missing image rejected" "$bad.none" "" "? image open failed"
+  expect_contains "SAVE-IMAGE bad path recovers" $'S" /nonexistent/x.img" SAVE-IMAGE\n1 2 + .\n' out "3 "
+  rm -f "$img" "$bad" "$out" "$err"
+}
+
+# run bootstrap + payload with the given region options
+expect_limits_contains() {
+  local label="$1"
+  local args="$2"
+  local payload="$3"
+  local needle="$4"
+  local out err
+  out="$(mktemp)"
+  err="$(mktemp)"
+  set +e
+  { cat bootstrap.fth; printf "%s" "$payload"; } | ./build/kforth $args >"$out" 2>"$err"
+  set -e
+  if grep -Fq -- "$needle" "$out"; then
+    report_pass "$label"
+  else
+    report_fail "$label" "$out" "$err" "expected '$needle' in out"
+  fi
+  rm -f "$out" "$err"
+}
+
+limits_suite() {
+  expect_limits_contains "--data-cells caps ALLOT" "--data-cells 60000" $'100000 ALLOT\n' "? data full"
+  expect_limits_contains "--data-cells keeps running" "--data-cells 60000" $'100000 ALLOT\n2 3 + .\n' "ok 5 "
+  expect_limits_contains "--code-cells caps ,C" "--code-cells 40000" $': CFILL BEGIN 0 ,C AGAIN ; CFILL\n' "? code full"
+  expect_limits_contains "--dict-words over the maximum" "--dict-words 20000" $'' "kforth: --dict-words must be "
+  expect_limits_contains "--dict-words below the core" "--dict-words 10" $'' "kforth: --dict-words must be "
+  expect_limits_contains "--data-cells below the layout" "--data-cells 100" $'' "kforth: --data-cells must be "
+  expect_limits_contains "error in : drops the definition" "--data-cells 60000" $': FOO 1 . [ 100000 ALLOT ] ;\n: BAZ 2 . ;\nFOO\nBAZ\n' "? FOO"
+  expect_limits_contains "error in : keeps later words" "--data-cells 60000" $': FOO 1 . [ 100000 ALLOT ] ;\n: BAZ 2 . ;\nBAZ\n' "ok 2 "
+  KFORTH_DATA_CELLS=60000 expect_limits_contains "KFORTH_DATA_CELLS caps ALLOT" "" $'100000 ALLOT\n' "? data full"
+}
+
+# only with SAVE-C and a C compiler; the app is built from this tree's sources
+save_c_suite() {
+  local dir out err depth=100
+  [[ "$PEEPHOLE" -eq 1 ]] && depth=100000   # deep recursion needs (TAIL)
+  dir="$(mktemp -d)"
+  out="$dir/out"
+  err="$dir/err"
+  run_with_bootstrap $': SQ DUP * ;\n: SUMSQ 0 SWAP 0 DO I SQ + LOOP ;\n: FIB DUP 2 < IF EXIT THEN DUP 1 - FIB SWAP 2 - FIB + ;\n: MK CREATE , DOES> @ 2* ;\n21 MK KK\nVARIABLE V\n: CNT DUP 0= IF EXIT THEN 1- CNT ;\n: MAIN 10 SUMSQ . 20 FIB . KK . 7 V ! V @ . '"$depth"$' CNT . S" hi" TYPE 3 S>F 2 S>F FDIV F. CR ;\nS" '"$dir/app.c"$'" SAVE-C MAIN\n' "$out" "$err"
+  if ! cc -O2 -I. "$dir/app.c" kf_io.c kf_dev.c -o "$dir/app" 2>"$err"; then
+    report_fail "SAVE-C app compiles" "$out" "$err" "cc failed"
+  elif "$dir/app" </dev/null >"$out" 2>"$err" && grep -Fq -- "285 6765 42 7 0 hi1.5000" "$out"; then
+    report_pass "SAVE-C app runs"
+  else
+    report_fail "SAVE-C app runs" "$out" "$err" "expected '285 6765 42 7 0 hi1.5000' in out"
+  fi
+  run_with_bootstrap $': MAIN 1 . 5 CONSTANT FIVE 2 . ;\nS" '"$dir/text.c"$'" SAVE-C MAIN\n' "$out" "$err"
+  if ! cc -O2 -I. "$dir/text.c" kf_io.c kf_dev.c -o "$dir/text" 2>"$err"; then
+    report_fail "SAVE-C app without text interpreter compiles" "$out" "$err" "cc failed"
+  elif ! "$dir/text" </dev/null >"$out" 2>"$err" && grep -Fq -- "no text interpreter" "$out"; then
+    report_pass "SAVE-C app has no text interpreter"
+  else
+    report_fail "SAVE-C app has no text interpreter" "$out" "$err" "expected 'no text interpreter' in out"
+  fi
+  expect_contains "SAVE-C bad path recovers" $': M 1 ;\nS" /nonexistent/x.c" SAVE-C M\n1 2 + .\n' out "3 "
+  rm -rf "$dir"
+}
+
+# only when built with -DKFORTH_PROFILE=ON
+profile_suite() {
+  local folded out err
+  folded="$(mktemp)"
+  out="$(mktemp)"
+  err="$(mktemp)"
+  local defs=$': SQ DUP * ;\n: SUMSQ 0 SWAP 0 DO I SQ + LOOP ;\n: TWICE SUMSQ SUMSQ ;\n'
+  expect_contains "PROFILE-REPORT calls" "$defs"$'PROFILE-ON 10 DUP TWICE 2DROP PROFILE-OFF PROFILE-REPORT\n' out "         2 "
+  expect_contains "PROFILE-REPORT names word" "$defs"$'PROFILE-ON 3 TWICE DROP PROFILE-OFF PROFILE-REPORT\n' out "  SUMSQ"
+  expect_not_contains "PROFILE-RESET clears" "$defs"$'PROFILE-ON 3 TWICE DROP PROFILE-OFF PROFILE-RESET PROFILE-REPORT\n' out "  SUMSQ"
+  { cat bootstrap.fth; printf "%s" "$defs"$'PROFILE-RESET 3 TWICE DROP\n'; } \
+    | ./build/kforth --profile "$folded" >"$out" 2>"$err"
+  if grep -Eq '^TWICE;SUMSQ;(SQ;)?DUP [0-9]+$' "$folded"; then
+    report_pass "--profile folded stacks"
+  else
+    report_fail "--profile folded stacks" "$folded" "$err" "expected TWICE;SUMSQ;...DUP line"
+  fi
+  rm -f "$folded" "$out" "$err"
+}
+
+# only when built with -DKFORTH_JIT=ON; words are compiled on their second call
+jit_suite() {
+  expect_contains "JIT loop and call" $': SQ DUP * ;\n: SUMSQ 0 SWAP 0 DO I SQ + LOOP ;\n10 SUMSQ . 10 SUMSQ . 100 SUMSQ .\n' out "285 285 328350 "
+  expect_contains "JIT recursion" $': FIB DUP 2 < IF EXIT THEN DUP 1 - FIB SWAP 2 - FIB + ;\n20 FIB .\n' out "6765 "
+  expect_contains "JIT DOES> word" $': MK CREATE , DOES> @ 2* ;\n21 MK KK\n: RK KK KK + ;\nRK . RK . RK .\n' out "84 84 84 "
+  expect_contains "JIT ?DO LEAVE I+@" $'CREATE AR 5 , 6 , 7 , : IA 0 SWAP 0 ?DO AR I + @ + I 1 = IF LEAVE THEN LOOP ;\n3 IA . 3 IA . 3 IA . 0 IA .\n' out "11 11 11 0 "
+  expect_contains "JIT tail recursion" $': CNT DUP 0= IF EXIT THEN 1- CNT ;\n100000 CNT . 100000 CNT . 100000 CNT .\n' out "0 0 0 "
+  expect_contains "JIT underflow recovers" $': U DROP ;\nU U U\n1 2 + .\n' out "3 "
+  expect_contains "JIT CODE! invalidates" $'HEREC : PW 1 ; PW . PW . PW . 5 OVER 1+ CODE! DROP PW .\n' out "1 1 1 5 "
+  expect_contains "JIT-OFF interprets" $': SQ DUP * ;\nJIT-OFF 3 SQ . 3 SQ . 3 SQ . JIT-ON 4 SQ .\n' out "9 9 9 16 "
+}
+
+# only with KFORTH_TASKS (PAUSE in WORDS)
+tasks_suite() {
+  local out err
+  out="$(mktemp)"
+  err="$(mktemp)"
+  local counter=$'VARIABLE N TASK T1\n: GO T1 ACTIVATE BEGIN N @ 1+ N ! PAUSE AGAIN ;\n'
+  expect_contains "PAUSE runs a task" "$counter"$'GO PAUSE PAUSE PAUSE N @ .\n' out "3 "
+  expect_contains "tasks take turns" $'TASK T1 TASK T2\n: A3 T1 ACTIVATE 3 0 DO 65 EMIT PAUSE LOOP ;\n: B3 T2 ACTIVATE 3 0 DO 66 EMIT PAUSE LOOP ;\nA3 B3 PAUSE PAUSE PAUSE PAUSE 7 .\n' out "ABABAB7 "
+  expect_contains "STOP ends turns" $'VARIABLE N TASK T1\n: S T1 ACTIVATE BEGIN N @ 1+ N ! STOP AGAIN ;\nS PAUSE PAUSE PAUSE N @ .\n' out "1 "
+  expect_contains "USER per task" $'USER U 5 U ! TASK T1\n: G T1 ACTIVATE 7 U ! U @ . ;\nG PAUSE U @ .\n' out "7 5 "
+  expect_contains "PAUSE in hot words" $'VARIABLE N TASK T1\n: TICK N @ 1+ N ! PAUSE ;\n: GO T1 ACTIVATE BEGIN TICK AGAIN ;\n: TICKS 0 DO TICK LOOP ;\nGO 10 TICKS N @ . 10 TICKS N @ .\n' out "20 40 "
+  expect_contains "MS sleeps a task" $'VARIABLE F TASK T1\n: W T1 ACTIVATE 20 MS 1 F ! ;\nW PAUSE F @ . 50 MS F @ .\n' out "0 1 "
+  expect_contains "MS runs tasks" "$counter"$'GO 10 MS N @ 5 > .\n' out "-1 "
+  expect_contains "IO@ without data pauses" "$counter"$'GO 0 IO@ 2DROP 0 IO@ 2DROP N @ .\n' out "2 "
+  expect_contains "KEY in a task" $'TASK T1\n: K T1 ACTIVATE KEY EMIT ;\nK PAUSE\nZ\n' out "Z"
+  expect_contains "task error stops it" $'TASK T1\n: E T1 ACTIVATE DROP ;\nE PAUSE\nPAUSE 43 .\n' out "? data stack underflow"
+  expect_contains "task error leaves the operator's word" $'TASK T1 : BAD T1 ACTIVATE 5 MS DROP DROP ;\n: RUN 1 2 3 BAD 0 BEGIN 1+ 2 MS DUP 10 = UNTIL . ." run-done " . . . ;\nRUN\n' out "10 run-done 3 2 1 "
+  expect_contains "task stack overflow" $'TASK T1\n: D T1 ACTIVATE 40 0 DO I LOOP PAUSE ;\nD PAUSE\nPAUSE 6 .\n' out "? task stack overflow"
+  expect_contains "ACTIVATE not a task" $': X 5 ACTIVATE ;\nX\n1 .\n' out "? ACTIVATE not a task"
+  { cat bootstrap.fth; printf "%s" "$counter"$'GO\n'; sleep 0.3; printf 'N @ 100 > .\n'; } | ./build/kforth >"$out" 2>"$err"
+  if grep -Fq -- "-1 " "$out"; then
+    report_pass "tasks run while waiting for input"
+  else
+    report_fail "tasks run while waiting for input" "$out" "$err" "expected '-1 ' in out"
+  fi
+  rm -f "$out" "$err"
+}
+
+# only with KFORTH_FILES (MAP-FILE in WORDS)
+files_suite() {
+  local dir
+  dir="$(mktemp -d)"
+  printf 'line one\r\nline two\n\nlast' > "$dir/a.txt"
+  { head -c 300000 /dev/zero; printf 'xx needle yy'; } > "$dir/big"
+  local open="CREATE BUF 100 ALLOT S\" $dir/a.txt\" R/O OPEN-FILE DROP CONSTANT FD"$'\n'
+  expect_contains "FILE-SIZE" "$open"$'FD FILE-SIZE . . .\n' out "0 0 24 "
+  expect_contains "READ-LINE strips CR LF" "$open"$'BUF 100 FD READ-LINE . . . BUF 8 TYPE\n' out "0 -1 8 line one"
+  expect_contains "READ-LINE to the end" "$open"$': RL BUF 100 FD READ-LINE . . . ; RL RL RL RL RL\n' out "0 -1 8 0 -1 8 0 -1 0 0 -1 4 0 0 0 "
+  expect_contains "REPOSITION-FILE READ-FILE" "$open"$'5 0 FD REPOSITION-FILE . BUF 3 FD READ-FILE . . BUF 3 TYPE FD FILE-POSITION . . .\n' out "0 0 3 one0 0 8 "
+  expect_contains "CLOSE-FILE twice" "$open"$'FD CLOSE-FILE . FD CLOSE-FILE .\n' out "0 -1 "
+  expect_contains "CREATE-FILE WRITE-LINE" "S\" $dir/o.txt\" W/O CREATE-FILE DROP CONSTANT FO S\" abc\" FO WRITE-LINE . S\" de\" FO WRITE-FILE . FO CLOSE-FILE ."$'\n'"S\" $dir/o.txt\" R/O BIN OPEN-FILE DROP FILE-SIZE . . ."$'\n' out "0 0 6 "
+  expect_contains "OPEN-FILE missing file" "S\" $dir/none\" R/O OPEN-FILE . ."$'\n' out "2 0 "
+  local map="S\" $dir/a.txt\" MAP-FILE . . CONSTANT M"$'\n'
+  expect_contains "MAP-FILE C@ TYPE COMPARE" "$map"$'M C@ EMIT M 5 + 3 TYPE M 4 S" line" COMPARE .\n' out "lone0 "
+  expect_contains "MAP-FILE @ L@" "$map"$'M BYTE>CELL @ M L@ = .\n' out "-1 "
+  expect_contains "MAP-FILE SEARCH" "S\" $dir/big\" MAP-FILE DROP OVER CONSTANT M S\" needle\" SEARCH . . M - ."$'\n' out "-1 9 300003 "
+  expect_contains "MAP-FILE scan in a loop" "S\" $dir/big\" MAP-FILE DROP OVER CONSTANT M"$'\n: SCAN 0 SWAP 0 DO M I + C@ + LOOP ; SCAN .\n' out "1167 "
+  expect_fatal_contains "MAP-FILE is read-only" "$map"$'0 M C!\n' out "? C! bad"
+  expect_fatal_contains "MAP-FILE past the end" "$map"$'M 24 + C@\n' out "? C@ bad"
+  rm -rf "$dir"
+}
+
+# only on Linux hosts (IO-OPEN succeeds on /dev/ptmx)
+dev_suite() {
+  local dir out err
+  dir="$(mktemp -d)"
+  out="$(mktemp)"
+  err="$(mktemp)"
+  mkfifo "$dir/p"
+  local pty=$'VARIABLE M VARIABLE S CREATE BUF 64 ALLOT\nS" /dev/ptmx" 2 IO-OPEN DROP M ! 0 4 M @ IOCTL DROP S !\n'
+  expect_contains "pty peer IO-WAIT READ-BLOCK" "$pty"$'S" ping" M @ WRITE-BLOCK . . 1 S @ LSHIFT 500 IO-WAIT 1 S @ LSHIFT = .\nBUF 64 S @ READ-BLOCK . . BUF 4 TYPE\n' out "-1 4 ping"
+  expect_contains "IO-WAIT times out" "$pty"$'1 S @ LSHIFT 30 IO-WAIT .\n' out "0 "
+  expect_contains "READ-BLOCK would block" "$pty"$'BUF 8 S @ READ-BLOCK . . 0 0 S @ IOCTL . .\n' out "-1 0 -1 0 "
+  expect_contains "fifo roundtrip" "S\" $dir/p\" 0 IO-OPEN . CONSTANT PR S\" $dir/p\" 1 IO-OPEN . CONSTANT PW"$'\nCREATE BUF 8 ALLOT S" abc" PW WRITE-BLOCK . . 1 PR LSHIFT 0 IO-WAIT 1 PR LSHIFT = .\nBUF 8 PR READ-BLOCK . . BUF 3 TYPE\n' out "-1 3 abc"
+  expect_contains "file roundtrip and eof" "S\" $dir/f\" 5 IO-OPEN . CONSTANT FW S\" hello\" FW WRITE-BLOCK . . FW IO-CLOSE ."$'\nCREATE BUF 8 ALLOT '"S\" $dir/f\" 0 IO-OPEN . CONSTANT FR"$' BUF 8 FR READ-BLOCK . . BUF 5 TYPE BUF 8 FR READ-BLOCK . . 0 3 FR IOCTL . .\n' out "-1 -1 5 hello0 0 -1 -1 "
+  expect_contains "600-byte frame" "S\" $dir/big\" 6 IO-OPEN DROP CONSTANT FH"$'\nCREATE BUF 600 ALLOT BUF 600 66 FILL BUF 600 FH WRITE-BLOCK . . FH IO-CLOSE DROP\n' out "-1 600 "
+  expect_contains "READ-BLOCK whole frame" "S\" $dir/big\" 0 IO-OPEN DROP CONSTANT FH"$'\nCREATE BUF 700 ALLOT 0 0 FH IOCTL . . BUF 700 FH READ-BLOCK . . BUF 599 + C@ .\n' out "-1 600 -1 600 66 "
+  expect_fatal_contains "READ-BLOCK bad span" $'4194000 1000 1 READ-BLOCK\n' out "? READ-BLOCK bad"
+  expect_contains "IO-OPEN missing file" "S\" $dir/none\" 0 IO-OPEN . ."$'\n' out "0 0 "
+  expect_contains "IO-CLOSE bad handle" $'99 IO-CLOSE .\n' out "0 "
+  if printf 'WORDS\n' | ./build/kforth | grep -q 'PAUSE'; then
+    expect_contains "IO-WAIT in a task" "$pty"$'TASK T1 : R T1 ACTIVATE 1 S @ LSHIFT -1 IO-WAIT . 33 EMIT ;\nR PAUSE PAUSE 5 . S" x" M @ WRITE-BLOCK 2DROP 20 MS 6 .\n' out "5 4 !6 "
+    expect_contains "IO-WAIT runs tasks" "$pty"$'VARIABLE N TASK T2 : GO T2 ACTIVATE BEGIN N @ 1+ N ! PAUSE AGAIN ;\nGO 1 S @ LSHIFT 30 IO-WAIT . N @ 5 > .\n' out "0 -1 "
+  fi
+  rm -rf "$dir"
+  rm -f "$out" "$err"
+}
+
 string_suite() {
   expect_contains "S\" TYPE" $'S" HI" TYPE\n' out "HI"
+  expect_contains "TYPE zero length" $'S" HI" DROP 0 TYPE 7 .\n' out "7 "
+  expect_contains "FLUSH keeps order" $'65 EMIT FLUSH 66 EMIT CR\n' out "AB"
+  expect_contains "output past buffer size" $': LOTS 5000 0 DO 46 EMIT LOOP 88 EMIT ; LOTS\n' out ".....X"
   expect_contains ".\"" $'.\" hello\"\n' out "hello"
   expect_contains "ABORT\" false continues" $'0 ABORT" no"\n1 2 + .\n' out "3 "
   expect_contains "ABORT\" true message" $'1 ABORT" stop"\n' out "stop"
+  expect_contains "interpret S\" leaves HERE" $'HERE S" abc" 2DROP S" defg" 2DROP HERE = .\n' out "-1 "
+  expect_contains "two transient strings" $'S" one" S" two" TYPE TYPE\n' out "twoone"
+  expect_contains "two long transient strings" "S\" $(printf 'a%.0s' {1..300})\" S\" $(printf 'b%.0s' {1..300})\" DROP C@ EMIT DROP C@ EMIT"$'\n' out "ba"
+  local spin
+  spin="$(for i in $(seq 40); do printf 'S" 0123456789012345678901234567890123456789" 2DROP '; done)"
+  expect_contains "compiled S\" survives the ring" $': KS S" keep" ; HERE\n'"$spin"$'\nKS TYPE HERE = .\n' out "keep-1 "
+  expect_contains "PARSE past the line" $'HERE 32 PARSE\nxyz\nTYPE HERE = .\n' out "xyz-1 "
   expect_contains "KEY sequence" $': K2 KEY . KEY . ;\nK2\nAB\n' out "65 66 "
   expect_contains "KEY EOF returns 0" $': KEOF KEY . ;\nKEOF\n' out "0 "
 }
 
 build
+# superinstructions only exist with -DKFORTH_PEEPHOLE=ON
+PEEPHOLE=0
+if printf ': P 1 + ; SEE P\n' | ./build/kforth | grep -q 'LIT+'; then
+  PEEPHOLE=1
+fi
 core_suite
 advanced_suite
 internal_primitive_suite
 bootstrap_behavior_suite
 bootstrap_presence_suite
 fatal_suite
+if printf 'WORDS\n' | ./build/kforth | grep -q 'SAVE-IMAGE'; then
+  image_suite
+else
+  echo "INFO: image suite skipped (build with -DKFORTH_IMAGE=ON)"
+fi
+limits_suite
+if ! printf 'WORDS\n' | ./build/kforth | grep -q 'SAVE-C'; then
+  echo "INFO: save-c suite skipped (build with -DKFORTH_SAVE_C=ON)"
+elif ! command -v cc >/dev/null; then
+  echo "INFO: save-c suite skipped (no cc)"
+else
+  save_c_suite
+fi
+if printf 'WORDS\n' | ./build/kforth | grep -q 'PROFILE-ON'; then
+  profile_suite
+else
+  echo "INFO: profile suite skipped (build with -DKFORTH_PROFILE=ON)"
+fi
+if printf 'WORDS\n' | ./build/kforth | grep -q 'MAP-FILE'; then
+  files_suite
+else
+  echo "INFO: files suite skipped (build with -DKFORTH_FILES=ON)"
+fi
+if printf 'S" /dev/ptmx" 2 IO-OPEN . IO-CLOSE DROP\n' | ./build/kforth | grep -q -- '-1 '; then
+  dev_suite
+else
+  echo "INFO: dev suite skipped (no Linux pty)"
+fi
+if printf 'WORDS\n' | ./build/kforth | grep -q 'PAUSE'; then
+  tasks_suite
+else
+  echo "INFO: tasks suite skipped (build with -DKFORTH_TASKS=ON)"
+fi
+if printf 'WORDS\n' | ./build/kforth | grep -q 'JIT-ON'; then
+  jit_suite
+else
+  echo "INFO: jit suite skipped (build with -DKFORTH_JIT=ON on x86-64 Linux)"
+fi
 
 if [[ "$RUN_STRINGS" -eq 1 ]]; then
   string_suite